@@ -0,0 +1,281 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Allocation tracking.
+//
+// Opt-in: build with TRACK_ALLOCATIONS defined and the global operator new/delete are
+// replaced by versions that count every allocation (count and bytes), both in total
+// and for the innermost ALLOC_SCOPE on the current thread. EndFrame() turns the
+// counters into per-frame numbers for the overlay, the CSV export and the budget check.
+// Without TRACK_ALLOCATIONS nothing is hooked, ALLOC_SCOPE compiles to nothing and
+// every count stays 0.
+
+// Tags that get their own column in the per-frame history
+const int MAX_ALLOC_TAGS = 16;
+
+struct AllocCounters
+{
+    std::atomic<std::uint64_t> count{ 0 };
+    std::atomic<std::uint64_t> bytes{ 0 };
+    std::atomic<std::uint64_t> frees{ 0 };
+    std::atomic<std::uint64_t> freedBytes{ 0 };
+};
+
+// A named scope allocations are attributed to. Made once per ALLOC_SCOPE (function static).
+struct AllocTag
+{
+    const char* name;
+    int index = -1; // column in the history, -1 once MAX_ALLOC_TAGS is reached
+    AllocCounters counters;
+    AllocTag* next = nullptr;
+    // Counter values at the start of the current frame
+    std::uint64_t frameStartCount = 0;
+    std::uint64_t frameStartBytes = 0;
+
+    explicit AllocTag(const char* _name);
+};
+
+AllocCounters allocTotals;
+AllocTag* allocTagList = nullptr;
+int allocTagCount = 0;
+std::mutex allocTagMutex;
+thread_local AllocTag* currentAllocTag = nullptr;
+
+AllocTag::AllocTag(const char* _name) : name(_name)
+{
+    std::lock_guard<std::mutex> lock(allocTagMutex);
+    if (allocTagCount < MAX_ALLOC_TAGS) index = allocTagCount++;
+    next = allocTagList;
+    allocTagList = this;
+}
+
+// Attributes allocations on this thread to tag until it goes out of scope
+struct AllocScope
+{
+    AllocTag* previous;
+    explicit AllocScope(AllocTag& tag) : previous(currentAllocTag) { currentAllocTag = &tag; }
+    ~AllocScope() { currentAllocTag = previous; }
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+};
+
+#ifdef TRACK_ALLOCATIONS
+#define ALLOC_SCOPE_JOIN2(a, b) a##b
+#define ALLOC_SCOPE_JOIN(a, b) ALLOC_SCOPE_JOIN2(a, b)
+#define ALLOC_SCOPE(name) \
+    static AllocTag ALLOC_SCOPE_JOIN(allocTag_, __LINE__)(name); \
+    AllocScope ALLOC_SCOPE_JOIN(allocScope_, __LINE__)(ALLOC_SCOPE_JOIN(allocTag_, __LINE__))
+#else
+#define ALLOC_SCOPE(name) ((void)0)
+#endif
+
+struct FrameAllocStats
+{
+    std::uint64_t frame = 0;
+    std::uint64_t allocs = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t frees = 0;
+    // Bytes allocated and not yet freed at the end of the frame
+    std::int64_t liveBytes = 0;
+    std::array<std::uint32_t, MAX_ALLOC_TAGS> tagAllocs = {};
+    std::array<std::uint64_t, MAX_ALLOC_TAGS> tagBytes = {};
+};
+
+class AllocTracker
+{
+private:
+    std::uint64_t frameStartCount = 0;
+    std::uint64_t frameStartBytes = 0;
+    std::uint64_t frameStartFrees = 0;
+
+public:
+    // Allocations per frame above which a frame counts as over budget (-1 = no budget)
+    long long budgetPerFrame = -1;
+    // First frames are not held to the budget (font glyphs, first texture uploads, ...)
+    std::uint64_t budgetWarmupFrames = 10;
+    // Frames kept for the CSV export (oldest are dropped)
+    std::size_t historyLimit = 100000;
+
+    std::vector<FrameAllocStats> history;
+    FrameAllocStats lastFrame;
+    FrameAllocStats worstFrame;
+    std::uint64_t frameCount = 0;
+    std::uint64_t framesOverBudget = 0;
+
+    static bool isEnabled()
+    {
+#ifdef TRACK_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Starts frame counting from here, so start-up allocations are not in frame 0
+    void Start()
+    {
+        history.clear();
+        history.reserve(std::min<std::size_t>(historyLimit, 4096));
+        frameStartCount = allocTotals.count.load(std::memory_order_relaxed);
+        frameStartBytes = allocTotals.bytes.load(std::memory_order_relaxed);
+        frameStartFrees = allocTotals.frees.load(std::memory_order_relaxed);
+        for (AllocTag* tag = allocTagList; tag != nullptr; tag = tag->next)
+        {
+            tag->frameStartCount = tag->counters.count.load(std::memory_order_relaxed);
+            tag->frameStartBytes = tag->counters.bytes.load(std::memory_order_relaxed);
+        }
+        lastFrame = worstFrame = FrameAllocStats();
+        frameCount = framesOverBudget = 0;
+    }
+
+    // Closes the current frame: per-frame deltas, budget check, history
+    void EndFrame()
+    {
+        std::uint64_t count = allocTotals.count.load(std::memory_order_relaxed);
+        std::uint64_t bytes = allocTotals.bytes.load(std::memory_order_relaxed);
+        std::uint64_t frees = allocTotals.frees.load(std::memory_order_relaxed);
+        std::uint64_t freedBytes = allocTotals.freedBytes.load(std::memory_order_relaxed);
+
+        FrameAllocStats frame;
+        frame.frame = frameCount++;
+        frame.allocs = count - frameStartCount;
+        frame.bytes = bytes - frameStartBytes;
+        frame.frees = frees - frameStartFrees;
+        frame.liveBytes = (std::int64_t)(bytes - freedBytes);
+        frameStartCount = count;
+        frameStartBytes = bytes;
+        frameStartFrees = frees;
+
+        for (AllocTag* tag = allocTagList; tag != nullptr; tag = tag->next)
+        {
+            std::uint64_t tagCount = tag->counters.count.load(std::memory_order_relaxed);
+            std::uint64_t tagBytes = tag->counters.bytes.load(std::memory_order_relaxed);
+            if (tag->index != -1)
+            {
+                frame.tagAllocs[tag->index] = (std::uint32_t)(tagCount - tag->frameStartCount);
+                frame.tagBytes[tag->index] = tagBytes - tag->frameStartBytes;
+            }
+            tag->frameStartCount = tagCount;
+            tag->frameStartBytes = tagBytes;
+        }
+
+        if (frame.frame >= budgetWarmupFrames)
+        {
+            if (budgetPerFrame >= 0 && frame.allocs > (std::uint64_t)budgetPerFrame) framesOverBudget++;
+            if (frame.allocs >= worstFrame.allocs) worstFrame = frame;
+        }
+        lastFrame = frame;
+
+        if (history.size() >= historyLimit) history.erase(history.begin(), history.begin() + historyLimit / 2);
+        history.push_back(frame);
+    }
+
+    // Last frame's numbers plus the tags that allocated in it, for the on-screen overlay
+    std::string getOverlayText()
+    {
+        std::ostringstream ss;
+        ss << "allocs/frame: " << lastFrame.allocs << " (" << lastFrame.bytes / 1024 << " KB) | live "
+            << lastFrame.liveBytes / (1024 * 1024) << " MB | worst " << worstFrame.allocs;
+        if (budgetPerFrame >= 0) ss << " | budget " << budgetPerFrame << ", over in " << framesOverBudget << " frames";
+        for (AllocTag* tag = allocTagList; tag != nullptr; tag = tag->next)
+        {
+            if (tag->index == -1 || lastFrame.tagAllocs[tag->index] == 0) continue;
+            std::uint64_t tagBytes = lastFrame.tagBytes[tag->index];
+            ss << " | " << tag->name << " " << lastFrame.tagAllocs[tag->index] << " ("
+                << (tagBytes < 1024 ? tagBytes : tagBytes / 1024) << (tagBytes < 1024 ? " B)" : " KB)");
+        }
+        return ss.str();
+    }
+
+    // Writes the frame history as CSV: frame, allocs, bytes, frees, live bytes, then allocations
+    // and bytes of every tag
+    bool ExportCsv(const std::string& path)
+    {
+        std::ofstream out(path, std::ios::trunc);
+        if (!out) return false;
+
+        std::vector<AllocTag*> tags(allocTagCount, nullptr);
+        for (AllocTag* tag = allocTagList; tag != nullptr; tag = tag->next)
+        {
+            if (tag->index != -1) tags[tag->index] = tag;
+        }
+
+        out << "frame,allocs,bytes,frees,live_bytes";
+        for (AllocTag* tag : tags) out << "," << tag->name;
+        for (AllocTag* tag : tags) out << "," << tag->name << " bytes";
+        out << "\n";
+        for (const FrameAllocStats& frame : history)
+        {
+            out << frame.frame << "," << frame.allocs << "," << frame.bytes << "," << frame.frees << "," << frame.liveBytes;
+            for (std::size_t i = 0; i < tags.size(); i++) out << "," << frame.tagAllocs[i];
+            for (std::size_t i = 0; i < tags.size(); i++) out << "," << frame.tagBytes[i];
+            out << "\n";
+        }
+        return (bool)out;
+    }
+};
+
+AllocTracker allocTracker;
+
+#ifdef TRACK_ALLOCATIONS
+// Every block carries its size in front of it so deletes can be counted in bytes
+const std::size_t ALLOC_HEADER = alignof(std::max_align_t);
+
+void* trackedAlloc(std::size_t size)
+{
+    void* block = std::malloc(size + ALLOC_HEADER);
+    if (block == nullptr) return nullptr;
+    *static_cast<std::size_t*>(block) = size;
+    allocTotals.count.fetch_add(1, std::memory_order_relaxed);
+    allocTotals.bytes.fetch_add(size, std::memory_order_relaxed);
+    if (currentAllocTag != nullptr)
+    {
+        currentAllocTag->counters.count.fetch_add(1, std::memory_order_relaxed);
+        currentAllocTag->counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    return static_cast<char*>(block) + ALLOC_HEADER;
+}
+
+void trackedFree(void* p)
+{
+    if (p == nullptr) return;
+    char* block = static_cast<char*>(p) - ALLOC_HEADER;
+    std::size_t size = *reinterpret_cast<std::size_t*>(block);
+    allocTotals.frees.fetch_add(1, std::memory_order_relaxed);
+    allocTotals.freedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (currentAllocTag != nullptr) currentAllocTag->counters.frees.fetch_add(1, std::memory_order_relaxed);
+    std::free(block);
+}
+
+void* operator new(std::size_t size)
+{
+    void* p = trackedAlloc(size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](std::size_t size)
+{
+    void* p = trackedAlloc(size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return trackedAlloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return trackedAlloc(size); }
+void operator delete(void* p) noexcept { trackedFree(p); }
+void operator delete[](void* p) noexcept { trackedFree(p); }
+void operator delete(void* p, std::size_t) noexcept { trackedFree(p); }
+void operator delete[](void* p, std::size_t) noexcept { trackedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { trackedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { trackedFree(p); }
+#endif
@@ -0,0 +1,309 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include "MapExport.h"
+#include "ParallelFor.h"
+#include "TileTypeDefinitions.h"
+
+// Tile operations over a whole map or a rectangle of it: a type histogram and a set
+// ("every <from> becomes <to>") limited by a mask (all, map border, interior, next to a
+// type, not next to a type). Replace-all is the set with the ALL mask.
+//
+// The area is cut into bands of BULK_BAND_ROWS rows, one band per worker at a time. A
+// worker reads its band's map rows (plus the rows above and below for masks that look
+// at neighbours) and runs branch-free loops over the area's columns that the compiler
+// vectorises. Changed rows are handed to the writer afterwards, on the calling thread
+// in row order, so Map::WriteRow keeps its index and revisions up to date. Masks always
+// see the tiles as they were before the operation, a set never feeds its own mask.
+
+const int BULK_BAND_ROWS = 64;
+// from value of a set that matches every type
+const int BULK_ANY = -1;
+
+enum class BULKOP { HISTOGRAM = 0, SET = 1 };
+
+enum class BULKMASK { ALL = 0, BORDER = 1, INTERIOR = 2, TOUCHING = 3, NOT_TOUCHING = 4 };
+const std::array<std::string, 5> bulkMaskString = { "all", "border", "interior", "touching", "not-touching" };
+
+struct BulkMask
+{
+    BULKMASK kind = BULKMASK::ALL;
+    // The neighbour type of TOUCHING/NOT_TOUCHING
+    std::uint8_t type = 0;
+};
+
+struct BulkOp
+{
+    BULKOP kind = BULKOP::HISTOGRAM;
+    int from = BULK_ANY;
+    std::uint8_t to = 0;
+    BulkMask mask;
+};
+
+// Rows [r0, r0 + rows) x cols [c0, c0 + cols) of the map
+struct BulkArea
+{
+    int r0 = 0, c0 = 0, rows = 0, cols = 0;
+};
+
+struct BulkResult
+{
+    // Tiles of each type in the area (HISTOGRAM)
+    std::vector<std::uint64_t> histogram;
+    // Tiles changed (SET)
+    std::uint64_t changed = 0;
+    int rowsWritten = 0;
+    double ms = 0;
+};
+
+// Writes tiles [c0, c0 + n) of row r
+using BulkRowWriter = std::function<void(int row, int c0, int n, const std::uint8_t* in)>;
+
+// A tile type by name (tileTypeString) or id
+inline bool parseTileType(const std::string& s, std::uint8_t& out)
+{
+    for (int t = 0; t < TILETYPE_LEN; t++)
+    {
+        if (tileTypeString[t] == s || std::to_string(t) == s)
+        {
+            out = (std::uint8_t)t;
+            return true;
+        }
+    }
+    return false;
+}
+
+// "all", "border", "interior", "touching:<type>" or "not-touching:<type>"
+inline bool parseBulkMask(const std::string& s, BulkMask& out)
+{
+    std::size_t colon = s.find(':');
+    std::string name = s.substr(0, colon);
+    for (std::size_t i = 0; i < bulkMaskString.size(); i++)
+    {
+        if (bulkMaskString[i] != name) continue;
+        out.kind = static_cast<BULKMASK>(i);
+        bool needsType = out.kind == BULKMASK::TOUCHING || out.kind == BULKMASK::NOT_TOUCHING;
+        if (!needsType) return colon == std::string::npos;
+        return colon != std::string::npos && parseTileType(s.substr(colon + 1), out.type);
+    }
+    return false;
+}
+
+// Adds the types of p[0, n) to counts (typeCount entries, tiles must be < typeCount).
+// Single pass over four interleaved count tables: runs of the same tile (mostly blank) would
+// otherwise make every counts[p[i]]++ wait on the store of the previous one.
+inline void CountTypes(const std::uint8_t* p, int n, int typeCount, std::uint64_t* counts)
+{
+    std::uint32_t tables[4][256];
+    for (int k = 0; k < 4; k++) std::memset(tables[k], 0, typeCount * sizeof(std::uint32_t));
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        tables[0][p[i]]++;
+        tables[1][p[i + 1]]++;
+        tables[2][p[i + 2]]++;
+        tables[3][p[i + 3]]++;
+    }
+    for (; i < n; i++) tables[0][p[i]]++;
+    for (int t = 0; t < typeCount; t++) counts[t] += (std::uint64_t)tables[0][t] + tables[1][t] + tables[2][t] + tables[3][t];
+}
+
+// Tiles of p[0, n) equal to from (any type for BULK_ANY) become to. Returns how many changed.
+inline int ReplaceTypes(std::uint8_t* p, int n, int from, std::uint8_t to)
+{
+    int changed = 0;
+    if (from == BULK_ANY)
+    {
+        for (int i = 0; i < n; i++) changed += p[i] != to;
+        std::memset(p, to, n);
+        return changed;
+    }
+    const std::uint8_t f = (std::uint8_t)from;
+    if (f == to) return 0;
+    for (int i = 0; i < n; i++)
+    {
+        bool hit = p[i] == f;
+        changed += hit;
+        p[i] = hit ? to : p[i];
+    }
+    return changed;
+}
+
+// out[i] = 1 if tile (r, c0 + i) passes mask, else 0. above, row and below are whole
+// map rows, rows outside the map are filled with 0xFF (no type).
+inline void BuildMask(const BulkMask& mask, int r, int mapRows, int mapCols,
+    const std::uint8_t* above, const std::uint8_t* row, const std::uint8_t* below, int c0, int n, std::uint8_t* out)
+{
+    if (mask.kind == BULKMASK::ALL)
+    {
+        std::memset(out, 1, n);
+        return;
+    }
+    if (mask.kind == BULKMASK::BORDER || mask.kind == BULKMASK::INTERIOR)
+    {
+        std::uint8_t border = mask.kind == BULKMASK::BORDER ? 1 : 0;
+        bool edgeRow = r == 0 || r == mapRows - 1;
+        std::memset(out, edgeRow ? border : 1 - border, n);
+        if (c0 == 0) out[0] = border;
+        if (c0 + n == mapCols) out[n - 1] = border;
+        return;
+    }
+
+    const std::uint8_t k = mask.type;
+    auto touching = [&](int c) -> std::uint8_t
+    {
+        return (c > 0 && row[c - 1] == k) | (c < mapCols - 1 && row[c + 1] == k) | (above[c] == k) | (below[c] == k);
+    };
+    // Columns with both side neighbours in the map, then the map edges
+    int lo = std::max(c0, 1), hi = std::min(c0 + n, mapCols - 1);
+    std::uint8_t* o = out - c0;
+    for (int c = lo; c < hi; c++) o[c] = (row[c - 1] == k) | (row[c + 1] == k) | (above[c] == k) | (below[c] == k);
+    if (c0 == 0) o[0] = touching(0);
+    if (c0 + n == mapCols && mapCols > 1) o[mapCols - 1] = touching(mapCols - 1);
+    if (mask.kind == BULKMASK::NOT_TOUCHING)
+    {
+        for (int i = 0; i < n; i++) out[i] ^= 1;
+    }
+}
+
+// Tiles of p[0, n) with mask[i] set that equal from (any for BULK_ANY) become to. Returns how many changed.
+inline int SetMasked(std::uint8_t* p, const std::uint8_t* mask, int n, int from, std::uint8_t to)
+{
+    int changed = 0;
+    if (from == BULK_ANY)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            changed += mask[i] & (p[i] != to);
+            p[i] = mask[i] ? to : p[i];
+        }
+        return changed;
+    }
+    const std::uint8_t f = (std::uint8_t)from;
+    if (f == to) return 0;
+    for (int i = 0; i < n; i++)
+    {
+        bool hit = mask[i] & (p[i] == f);
+        changed += hit;
+        p[i] = hit ? to : p[i];
+    }
+    return changed;
+}
+
+// Runs op over area of a mapRows x mapCols map. readRow reads a whole map row and must be
+// safe to call from several threads unless threads is 1. writeRow gets every changed row
+// span; with parallelWrites it is called from the workers (only for masks that do not
+// look at neighbours, the others always write from the calling thread).
+inline BulkResult RunBulkOp(const BulkOp& op, const BulkArea& area, int mapRows, int mapCols, int typeCount,
+    const MapRowReader& readRow, const BulkRowWriter& writeRow, bool parallelWrites = false, int threads = 0)
+{
+    auto start = std::chrono::steady_clock::now();
+    BulkResult result;
+    result.histogram.assign(typeCount, 0);
+    if (area.rows <= 0 || area.cols <= 0)
+    {
+        result.ms = 0;
+        return result;
+    }
+
+    const bool set = op.kind == BULKOP::SET;
+    const bool neighbours = set && (op.mask.kind == BULKMASK::TOUCHING || op.mask.kind == BULKMASK::NOT_TOUCHING);
+    parallelWrites = parallelWrites && !neighbours;
+    const int bands = (area.rows + BULK_BAND_ROWS - 1) / BULK_BAND_ROWS;
+    const int workers = std::max(1, std::min(workerCount(threads), bands));
+
+    struct Band
+    {
+        // Map rows r0 - 1 .. r1 (halo rows only read for neighbour masks)
+        std::vector<std::uint8_t> rows;
+        // New tiles of the area columns, per band row
+        std::vector<std::uint8_t> out;
+        std::vector<std::uint8_t> mask;
+        std::vector<std::uint8_t> changed;
+        std::vector<std::uint64_t> histogram;
+        std::uint64_t changedTiles = 0;
+        int r0 = 0, n = 0;
+    };
+    std::vector<Band> work(workers);
+    // Original last row of the previous batch, which has been written back since
+    std::vector<std::uint8_t> carry(mapCols);
+    bool haveCarry = false;
+
+    for (int b0 = 0; b0 < bands; b0 += workers)
+    {
+        int count = std::min(workers, bands - b0);
+        parallelFor(count, [&](int k0, int k1)
+        {
+            for (int k = k0; k < k1; k++)
+            {
+                Band& w = work[k];
+                w.r0 = area.r0 + (b0 + k) * BULK_BAND_ROWS;
+                w.n = std::min(area.r0 + area.rows, w.r0 + BULK_BAND_ROWS) - w.r0;
+                w.rows.resize((std::size_t)(w.n + 2) * mapCols);
+                auto bandRow = [&w, mapCols](int i) { return &w.rows[(std::size_t)(i + 1) * mapCols]; };
+                for (int i = 0; i < w.n; i++) readRow(w.r0 + i, bandRow(i));
+                if (neighbours)
+                {
+                    if (w.r0 == 0) std::memset(bandRow(-1), 0xFF, mapCols);
+                    else if (k == 0 && haveCarry) std::memcpy(bandRow(-1), carry.data(), mapCols);
+                    else readRow(w.r0 - 1, bandRow(-1));
+                    if (w.r0 + w.n >= mapRows) std::memset(bandRow(w.n), 0xFF, mapCols);
+                    else readRow(w.r0 + w.n, bandRow(w.n));
+                }
+
+                w.histogram.assign(typeCount, 0);
+                w.changed.assign(w.n, 0);
+                w.changedTiles = 0;
+                if (!set)
+                {
+                    for (int i = 0; i < w.n; i++) CountTypes(bandRow(i) + area.c0, area.cols, typeCount, w.histogram.data());
+                    continue;
+                }
+                w.out.resize((std::size_t)w.n * area.cols);
+                w.mask.resize(area.cols);
+                for (int i = 0; i < w.n; i++)
+                {
+                    std::uint8_t* out = &w.out[(std::size_t)i * area.cols];
+                    std::memcpy(out, bandRow(i) + area.c0, area.cols);
+                    int changed;
+                    if (op.mask.kind == BULKMASK::ALL) changed = ReplaceTypes(out, area.cols, op.from, op.to);
+                    else
+                    {
+                        BuildMask(op.mask, w.r0 + i, mapRows, mapCols, bandRow(i - 1), bandRow(i), bandRow(i + 1), area.c0, area.cols, w.mask.data());
+                        changed = SetMasked(out, w.mask.data(), area.cols, op.from, op.to);
+                    }
+                    w.changed[i] = changed > 0;
+                    w.changedTiles += changed;
+                    if (changed > 0 && parallelWrites) writeRow(w.r0 + i, area.c0, area.cols, out);
+                }
+            }
+        }, threads);
+
+        if (neighbours)
+        {
+            const Band& last = work[count - 1];
+            std::memcpy(carry.data(), &last.rows[(std::size_t)last.n * mapCols], mapCols);
+            haveCarry = true;
+        }
+        for (int k = 0; k < count; k++)
+        {
+            Band& w = work[k];
+            for (int t = 0; t < typeCount; t++) result.histogram[t] += w.histogram[t];
+            result.changed += w.changedTiles;
+            for (int i = 0; i < w.n; i++)
+            {
+                if (!w.changed[i]) continue;
+                result.rowsWritten++;
+                if (!parallelWrites) writeRow(w.r0 + i, area.c0, area.cols, &w.out[(std::size_t)i * area.cols]);
+            }
+        }
+    }
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "MapExport.h"
+#include "ParallelFor.h"
+
+// Map CSV writer: "rows,cols" then one line of comma separated tile ids per map row.
+//
+// Rows are formatted with std::to_chars in blocks of CSV_BLOCK_ROWS, one buffer per
+// block, with the blocks of a batch formatted in parallel. Each buffer goes to disk
+// with a single write. Everything is written to "<path>.tmp", which replaces path with a
+// rename only once it is complete, so a crash or full disk mid-save leaves the old
+// file untouched.
+
+// Map rows formatted per buffer
+const int CSV_BLOCK_ROWS = 256;
+// Line break of saved maps, CRLF on Windows like the text mode stream the editor used to save with
+#ifdef _WIN32
+const char* const CSV_NEWLINE = "\r\n";
+#else
+const char* const CSV_NEWLINE = "\n";
+#endif
+
+struct CsvWriteResult
+{
+    bool ok = false;
+    std::string error;
+    std::uint64_t bytes = 0;
+};
+
+// Formats rows [r0, r1) into out (cleared first). row is scratch space of cols tiles.
+inline void FormatCsvRows(int r0, int r1, int cols, const MapRowReader& readRow, std::vector<std::uint8_t>& row, std::string& out)
+{
+    // At most 3 digits and a separator per tile, plus a \r per row
+    out.resize((std::size_t)(r1 - r0) * ((std::size_t)cols * 4 + 1) + 1);
+    char* p = &out[0];
+    row.resize(cols);
+    for (int r = r0; r < r1; r++)
+    {
+        readRow(r, row.data());
+        for (int j = 0; j < cols; j++)
+        {
+            p = std::to_chars(p, p + 3, row[j]).ptr;
+            if (j < cols - 1) *p++ = ',';
+        }
+        for (const char* nl = CSV_NEWLINE; *nl; nl++) *p++ = *nl;
+    }
+    out.resize(p - out.data());
+}
+
+// Writes the map to path as CSV through a temp file. readRow must be safe to call from
+// several threads at once unless threads is 1.
+inline CsvWriteResult WriteMapCsv(const std::string& path, int rows, int cols, const MapRowReader& readRow, int threads = 0)
+{
+    CsvWriteResult result;
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            result.error = "could not open '" + tmpPath + "' for writing";
+            return result;
+        }
+
+        std::string header = std::to_string(rows) + "," + std::to_string(cols) + CSV_NEWLINE;
+        out.write(header.data(), header.size());
+        result.bytes += header.size();
+
+        // A batch is one block per worker, formatted together then written in order
+        int blocks = (rows + CSV_BLOCK_ROWS - 1) / CSV_BLOCK_ROWS;
+        int batch = std::max(1, std::min(workerCount(threads), blocks));
+        std::vector<std::string> buffers(batch);
+        std::vector<std::vector<std::uint8_t>> scratch(batch);
+        for (int b0 = 0; b0 < blocks && out; b0 += batch)
+        {
+            int count = std::min(batch, blocks - b0);
+            parallelFor(count, [&](int k0, int k1)
+            {
+                for (int k = k0; k < k1; k++)
+                {
+                    int r0 = (b0 + k) * CSV_BLOCK_ROWS;
+                    FormatCsvRows(r0, std::min(rows, r0 + CSV_BLOCK_ROWS), cols, readRow, scratch[k], buffers[k]);
+                }
+            }, threads);
+            for (int k = 0; k < count; k++)
+            {
+                out.write(buffers[k].data(), buffers[k].size());
+                result.bytes += buffers[k].size();
+            }
+        }
+        out.flush();
+        if (!out)
+        {
+            out.close();
+            std::remove(tmpPath.c_str());
+            result.error = "write to '" + tmpPath + "' failed (disk full?)";
+            return result;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec)
+    {
+        std::remove(tmpPath.c_str());
+        result.error = "could not replace '" + path + "': " + ec.message();
+        return result;
+    }
+    result.ok = true;
+    return result;
+}
@@ -0,0 +1,296 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include "MazeGenerator.h"
+
+// PLAY mode entities (Pac-Man, ghosts, coins, pellets, effect particles), stored as
+// structure of arrays.
+//
+// Every component is its own array indexed by entity, so the per-frame passes (move,
+// animate, age) are plain loops over contiguous floats that the compiler vectorises.
+// Entities are removed by swapping in the last one (RemoveDead), so indices only stay
+// valid for entities added before every entity that can die.
+//
+// All entities are drawn with one draw call: a triangle list of quads into a small
+// atlas of animation frames that is generated at startup (one row per kind).
+
+enum class ENTITYKIND : std::uint8_t { PLAYER = 0, GHOST = 1, COIN = 2, PELLET = 3, PARTICLE = 4 };
+const int ENTITYKIND_LEN = 5;
+
+// Animation frames per kind and their size in the atlas
+const int ENTITY_FRAMES = 8;
+const int ENTITY_FRAME_SIZE = 16;
+// Frames per second of each kind's animation
+const std::array<float, ENTITYKIND_LEN> entityFrameRate = { 16, 8, 10, 6, 12 };
+// Lifetime of entities that never die
+const float ENTITY_FOREVER = std::numeric_limits<float>::infinity();
+
+// Animation frames, RGBA, ENTITY_FRAMES wide and ENTITYKIND_LEN high. Ghosts are white
+// and take their colour from the vertex tint.
+inline std::vector<std::uint8_t> BuildEntityAtlasPixels()
+{
+    const int S = ENTITY_FRAME_SIZE;
+    const int width = S * ENTITY_FRAMES;
+    const float pi = 3.14159265f;
+    std::vector<std::uint8_t> pixels((std::size_t)width * S * ENTITYKIND_LEN * 4, 0);
+    auto put = [&](int kind, int frame, int x, int y, std::uint8_t r, std::uint8_t g, std::uint8_t b, std::uint8_t a)
+    {
+        std::uint8_t* p = &pixels[(((std::size_t)kind * S + y) * width + (std::size_t)frame * S + x) * 4];
+        p[0] = r;
+        p[1] = g;
+        p[2] = b;
+        p[3] = a;
+    };
+
+    for (int f = 0; f < ENTITY_FRAMES; f++)
+    {
+        float t = (float)f / ENTITY_FRAMES;
+        for (int y = 0; y < S; y++)
+        {
+            for (int x = 0; x < S; x++)
+            {
+                float dx = x + 0.5f - S / 2.0f, dy = y + 0.5f - S / 2.0f;
+                float d = std::sqrt(dx * dx + dy * dy);
+
+                // Pac-Man facing right, the mouth opens and closes once per cycle
+                float mouth = 0.9f * (1 - std::fabs(2 * t - 1));
+                if (d <= 7 && std::fabs(std::atan2(dy, dx)) >= mouth) put(0, f, x, y, 255, 230, 0, 255);
+
+                // Ghost: dome, body and a skirt that ripples sideways, with eyes
+                float skirt = 12.5f + 1.5f * std::sin((x + f) * pi / 2);
+                bool body = (dy <= 0 && d <= 7) || (dy > 0 && std::fabs(dx) <= 7 && y <= skirt);
+                if (body)
+                {
+                    bool eye = (std::fabs(dx + 3) <= 1.5f || std::fabs(dx - 2) <= 1.5f) && dy >= -3 && dy <= 0;
+                    bool pupil = eye && (dx == -2.5f || dx == 2.5f) && dy >= -1.5f;
+                    if (pupil) put(1, f, x, y, 20, 20, 80, 255);
+                    else if (eye) put(1, f, x, y, 255, 255, 255, 255);
+                    else put(1, f, x, y, 235, 235, 235, 255);
+                }
+
+                // Coin spinning about its vertical axis
+                float half = 1 + 3.5f * std::fabs(std::cos(pi * t));
+                float e = (dx / half) * (dx / half) + (dy / 4.5f) * (dy / 4.5f);
+                if (e <= 1) put(2, f, x, y, e > 0.6f ? 200 : 255, e > 0.6f ? 150 : 210, 40, 255);
+
+                // Power pellet, pulsing
+                if (d <= 4.5f + 1.5f * std::sin(2 * pi * t)) put(3, f, x, y, 255, 190, 160, 255);
+
+                // Particle: a soft dot that shrinks
+                float radius = 1 + 5 * (1 - t);
+                if (d <= radius) put(4, f, x, y, 255, 255, 255, (std::uint8_t)(255 * (1 - d / (radius + 0.5f))));
+            }
+        }
+    }
+    return pixels;
+}
+
+class EntityStore
+{
+private:
+    MazeRng rng = MazeRng(1);
+    std::vector<sf::Vertex> vertices;
+
+    // Corner order of the atlas frame per facing (GameSim order: up, down, left, right,
+    // stopped), the frames are drawn facing right
+    static constexpr int facingCorners[5][4] = { { 1, 2, 3, 0 }, { 3, 0, 1, 2 }, { 1, 0, 3, 2 }, { 0, 1, 2, 3 }, { 0, 1, 2, 3 } };
+
+    float random() { return (float)(rng.next() >> 40) / (float)(1ull << 24); }
+
+public:
+    // Components. Positions are the entity centre in map pixels.
+    std::vector<float> x, y;
+    // Map pixels per second
+    std::vector<float> vx, vy;
+    // Animation position in frames, [0, ENTITY_FRAMES), and frames per second
+    std::vector<float> frame, frameRate;
+    // Seconds left to live
+    std::vector<float> life;
+    // Drawn width and height in map pixels
+    std::vector<float> size;
+    std::vector<ENTITYKIND> kind;
+    // Facing of movers (GameSim directions), the others stay at 3 (right)
+    std::vector<std::uint8_t> state;
+    std::vector<sf::Color> tint;
+
+    sf::Texture atlas;
+
+    std::size_t count() const { return x.size(); }
+
+    bool LoadAtlas()
+    {
+        std::vector<std::uint8_t> pixels = BuildEntityAtlasPixels();
+        sf::Vector2u atlasSize((unsigned)(ENTITY_FRAME_SIZE * ENTITY_FRAMES), (unsigned)(ENTITY_FRAME_SIZE * ENTITYKIND_LEN));
+        return atlas.loadFromImage(sf::Image(atlasSize, pixels.data()));
+    }
+
+    void Reserve(std::size_t n)
+    {
+        for (std::vector<float>* v : { &x, &y, &vx, &vy, &frame, &frameRate, &life, &size }) v->reserve(n);
+        kind.reserve(n);
+        state.reserve(n);
+        tint.reserve(n);
+    }
+
+    void Clear()
+    {
+        for (std::vector<float>* v : { &x, &y, &vx, &vy, &frame, &frameRate, &life, &size }) v->clear();
+        kind.clear();
+        state.clear();
+        tint.clear();
+    }
+
+    // Returns the new entity's index. Animations start at a random frame so coins do not spin in step.
+    std::size_t Add(ENTITYKIND k, float px, float py, float _size, sf::Color color = sf::Color::White, float lifetime = ENTITY_FOREVER)
+    {
+        x.push_back(px);
+        y.push_back(py);
+        vx.push_back(0);
+        vy.push_back(0);
+        frame.push_back(random() * ENTITY_FRAMES);
+        frameRate.push_back(entityFrameRate[(int)k]);
+        life.push_back(lifetime);
+        size.push_back(_size);
+        kind.push_back(k);
+        state.push_back(3);
+        tint.push_back(color);
+        return x.size() - 1;
+    }
+
+    // n particles flying out of (px, py) at up to speed pixels per second
+    void Burst(float px, float py, int n, float speed, float lifetime, sf::Color color)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            float angle = random() * 6.2831853f;
+            float v = speed * (0.3f + 0.7f * random());
+            std::size_t id = Add(ENTITYKIND::PARTICLE, px, py, ENTITY_FRAME_SIZE * 0.75f, color, lifetime * (0.5f + 0.5f * random()));
+            vx[id] = std::cos(angle) * v;
+            vy[id] = std::sin(angle) * v;
+            // Particles shrink over their life, not on a loop
+            frame[id] = 0;
+            frameRate[id] = ENTITY_FRAMES / life[id];
+        }
+    }
+
+    // Moves, animates and ages every entity
+    void Step(float dt)
+    {
+        const std::size_t n = count();
+        float* px = x.data();
+        float* py = y.data();
+        const float* pvx = vx.data();
+        const float* pvy = vy.data();
+        for (std::size_t i = 0; i < n; i++)
+        {
+            px[i] += pvx[i] * dt;
+            py[i] += pvy[i] * dt;
+        }
+
+        float* f = frame.data();
+        const float* rate = frameRate.data();
+        const float frames = (float)ENTITY_FRAMES, inverse = 1.0f / ENTITY_FRAMES;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            float next = f[i] + rate[i] * dt;
+            f[i] = next - frames * std::floor(next * inverse);
+        }
+
+        float* l = life.data();
+        for (std::size_t i = 0; i < n; i++) l[i] -= dt;
+    }
+
+    // Swaps the last entity into every dead one. Returns how many were removed.
+    std::size_t RemoveDead()
+    {
+        std::size_t n = count(), removed = 0;
+        for (std::size_t i = 0; i < n;)
+        {
+            if (life[i] > 0)
+            {
+                i++;
+                continue;
+            }
+            n--;
+            x[i] = x[n]; y[i] = y[n];
+            vx[i] = vx[n]; vy[i] = vy[n];
+            frame[i] = frame[n]; frameRate[i] = frameRate[n];
+            life[i] = life[n]; size[i] = size[n];
+            kind[i] = kind[n]; state[i] = state[n]; tint[i] = tint[n];
+            removed++;
+        }
+        if (removed == 0) return 0;
+        for (std::vector<float>* v : { &x, &y, &vx, &vy, &frame, &frameRate, &life, &size }) v->resize(n);
+        kind.resize(n);
+        state.resize(n);
+        tint.resize(n);
+        return removed;
+    }
+
+    // Ends every entity of kind k whose centre is within radius of (px, py). Returns how many.
+    int KillAt(ENTITYKIND k, float px, float py, float radius)
+    {
+        int killed = 0;
+        for (std::size_t i = 0; i < count(); i++)
+        {
+            if (kind[i] == k && std::fabs(x[i] - px) <= radius && std::fabs(y[i] - py) <= radius && life[i] > 0)
+            {
+                life[i] = 0;
+                killed++;
+            }
+        }
+        return killed;
+    }
+
+    // Rebuilds the vertex batch with the entities overlapping visible (map pixels).
+    // Returns how many were batched.
+    std::size_t BuildVertices(const sf::FloatRect& visible)
+    {
+        const std::size_t n = count();
+        vertices.resize(n * 6);
+        sf::Vertex* out = vertices.data();
+        const float S = (float)ENTITY_FRAME_SIZE;
+        float left = visible.position.x, top = visible.position.y;
+        float right = left + visible.size.x, bottom = top + visible.size.y;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            float half = size[i] / 2;
+            if (x[i] + half < left || x[i] - half > right || y[i] + half < top || y[i] - half > bottom) continue;
+
+            sf::Color c = tint[i];
+            // Fade out over the last half second
+            if (life[i] < 0.5f) c.a = (std::uint8_t)(c.a * std::max(0.0f, life[i] * 2));
+            float u = (float)(int)frame[i] * S, v = (float)(int)kind[i] * S;
+            sf::Vector2f uv[4] = { { u, v }, { u + S, v }, { u + S, v + S }, { u, v + S } };
+            const int* corner = facingCorners[std::min<int>(state[i], 4)];
+            sf::Vector2f p[4] = { { x[i] - half, y[i] - half }, { x[i] + half, y[i] - half }, { x[i] + half, y[i] + half }, { x[i] - half, y[i] + half } };
+
+            out[0] = { p[0], c, uv[corner[0]] };
+            out[1] = { p[1], c, uv[corner[1]] };
+            out[2] = { p[2], c, uv[corner[2]] };
+            out[3] = { p[0], c, uv[corner[0]] };
+            out[4] = { p[2], c, uv[corner[2]] };
+            out[5] = { p[3], c, uv[corner[3]] };
+            out += 6;
+        }
+        vertices.resize(out - vertices.data());
+        return vertices.size() / 6;
+    }
+
+    std::size_t batchedCount() const { return vertices.size() / 6; }
+
+    // One draw call for the batch BuildVertices made. transform maps map pixels to the target.
+    void Draw(sf::RenderTarget& target, const sf::Transform& transform) const
+    {
+        if (vertices.empty()) return;
+        sf::RenderStates states(&atlas);
+        states.transform = transform;
+        target.draw(vertices.data(), vertices.size(), sf::PrimitiveType::Triangles, states);
+    }
+};
@@ -0,0 +1,524 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "GameSim.h"
+
+#ifdef _WIN32
+// Main.cpp includes winsock2.h ahead of windows.h, which otherwise pulls in the old winsock.h
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET netSocket;
+const netSocket NET_BAD_SOCKET = INVALID_SOCKET;
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int netSocket;
+const netSocket NET_BAD_SOCKET = -1;
+#endif
+
+// A peer that hung up must not kill the process with SIGPIPE
+#ifdef MSG_NOSIGNAL
+const int NET_SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int NET_SEND_FLAGS = 0;
+#endif
+
+// Headless game server and bot client over loopback TCP.
+//
+// The server runs GameSim at a fixed tick rate. Every tick each client gets one snapshot,
+// a delta against the last tick it acknowledged (or a full one if it has acknowledged
+// none still in SNAPSHOT_HISTORY). Clients send inputs in batches, each batch also
+// acknowledging the newest tick they have. Everything is non-blocking and runs on one
+// thread, so server and bots can share a process for tests.
+//
+// Messages: u32 length (type + payload), u8 type, payload.
+//   WELCOME  server -> client  u16 entity id, u32 ticks per second
+//   SNAPSHOT server -> client  see EncodeSnapshot
+//   INPUT    client -> server  u32 acked tick (SNAPSHOT_FULL if none), varint count, count x (u32 tick, u8 dir)
+
+enum class NETMSG : std::uint8_t { WELCOME = 1, SNAPSHOT = 2, INPUT = 3 };
+
+const std::uint16_t DEFAULT_SERVER_PORT = 7777;
+// Ticks of entity history kept for deltas
+const std::uint32_t SNAPSHOT_HISTORY = 64;
+// A client this far behind (unsent bytes) skips snapshots until it catches up
+const std::size_t NET_MAX_BACKLOG = 1 << 20;
+const std::uint32_t NET_MAX_MESSAGE = 64u << 20;
+
+inline bool netStartup()
+{
+#ifdef _WIN32
+    static bool started = false;
+    if (started) return true;
+    WSADATA data;
+    started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    return started;
+#else
+    return true;
+#endif
+}
+
+inline void netClose(netSocket s)
+{
+    if (s == NET_BAD_SOCKET) return;
+#ifdef _WIN32
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+inline bool netWouldBlock()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+// Non-blocking, no Nagle delay (snapshots are sent as soon as they are made)
+inline void netConfigure(netSocket s)
+{
+#ifdef _WIN32
+    u_long on = 1;
+    ioctlsocket(s, FIONBIO, &on);
+#else
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    int noDelay = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+}
+
+// Listens on 127.0.0.1:port (0 = any free port, see netLocalPort)
+inline netSocket netListen(std::uint16_t port)
+{
+    if (!netStartup()) return NET_BAD_SOCKET;
+    netSocket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == NET_BAD_SOCKET) return s;
+    int reuse = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(s, 64) != 0)
+    {
+        netClose(s);
+        return NET_BAD_SOCKET;
+    }
+    netConfigure(s);
+    return s;
+}
+
+inline std::uint16_t netLocalPort(netSocket s)
+{
+    sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    if (getsockname(s, reinterpret_cast<sockaddr*>(&addr), &len) != 0) return 0;
+    return ntohs(addr.sin_port);
+}
+
+// Connects to 127.0.0.1:port (blocking), then makes the socket non-blocking
+inline netSocket netConnect(std::uint16_t port)
+{
+    if (!netStartup()) return NET_BAD_SOCKET;
+    netSocket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == NET_BAD_SOCKET) return s;
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        netClose(s);
+        return NET_BAD_SOCKET;
+    }
+    netConfigure(s);
+    return s;
+}
+
+// A socket with message framing and buffers on both sides
+class NetConnection
+{
+private:
+    std::vector<std::uint8_t> in;
+    std::size_t inRead = 0;
+    std::vector<std::uint8_t> out;
+    std::size_t outSent = 0;
+
+public:
+    netSocket socket = NET_BAD_SOCKET;
+    bool closed = false;
+    std::uint64_t bytesSent = 0, bytesReceived = 0;
+
+    NetConnection() {}
+    explicit NetConnection(netSocket s) : socket(s) {}
+    NetConnection(NetConnection&& other) noexcept { *this = std::move(other); }
+    NetConnection& operator=(NetConnection&& other) noexcept
+    {
+        std::swap(in, other.in);
+        std::swap(inRead, other.inRead);
+        std::swap(out, other.out);
+        std::swap(outSent, other.outSent);
+        std::swap(socket, other.socket);
+        std::swap(closed, other.closed);
+        std::swap(bytesSent, other.bytesSent);
+        std::swap(bytesReceived, other.bytesReceived);
+        return *this;
+    }
+    NetConnection(const NetConnection&) = delete;
+    NetConnection& operator=(const NetConnection&) = delete;
+    ~NetConnection() { netClose(socket); }
+
+    std::size_t backlog() const { return out.size() - outSent; }
+
+    void Queue(NETMSG type, const std::vector<std::uint8_t>& payload)
+    {
+        std::uint32_t length = (std::uint32_t)payload.size() + 1;
+        for (int k = 0; k < 4; k++) out.push_back((std::uint8_t)(length >> (8 * k)));
+        out.push_back((std::uint8_t)type);
+        out.insert(out.end(), payload.begin(), payload.end());
+    }
+
+    // Sends as much of the queue as the socket takes
+    void Flush()
+    {
+        while (!closed && outSent < out.size())
+        {
+            int n = (int)send(socket, reinterpret_cast<const char*>(out.data() + outSent), (int)(out.size() - outSent), NET_SEND_FLAGS);
+            if (n > 0)
+            {
+                outSent += n;
+                bytesSent += n;
+            }
+            else
+            {
+                if (n < 0 && netWouldBlock()) break;
+                closed = true;
+            }
+        }
+        if (outSent == out.size())
+        {
+            out.clear();
+            outSent = 0;
+        }
+    }
+
+    // Reads whatever has arrived
+    void Receive()
+    {
+        char buffer[64 * 1024];
+        while (!closed)
+        {
+            int n = (int)recv(socket, buffer, sizeof(buffer), 0);
+            if (n > 0)
+            {
+                in.insert(in.end(), buffer, buffer + n);
+                bytesReceived += n;
+            }
+            else
+            {
+                if (n < 0 && netWouldBlock()) break;
+                closed = true;
+            }
+        }
+    }
+
+    // Takes the next whole message off the input, false if none has fully arrived
+    bool Pop(NETMSG& type, std::vector<std::uint8_t>& payload)
+    {
+        if (in.size() - inRead < 5) return false;
+        const std::uint8_t* p = in.data() + inRead;
+        std::uint32_t length = p[0] | (p[1] << 8) | (p[2] << 16) | ((std::uint32_t)p[3] << 24);
+        if (length == 0 || length > NET_MAX_MESSAGE)
+        {
+            closed = true;
+            return false;
+        }
+        if (in.size() - inRead < 4 + (std::size_t)length) return false;
+        type = (NETMSG)p[4];
+        payload.assign(p + 5, p + 4 + length);
+        inRead += 4 + length;
+        if (inRead == in.size())
+        {
+            in.clear();
+            inRead = 0;
+        }
+        return true;
+    }
+};
+
+struct ServerStats
+{
+    std::uint64_t ticks = 0;
+    std::uint64_t snapshots = 0, fullSnapshots = 0, skipped = 0;
+    std::uint64_t snapshotBytes = 0;
+    std::uint64_t inputs = 0;
+    std::uint64_t clientTicks = 0; // clients connected, summed over ticks
+    double busySeconds = 0;        // time spent inside Tick
+};
+
+class GameServer
+{
+private:
+    struct Client
+    {
+        NetConnection conn;
+        std::uint16_t entity = 0;
+        std::uint32_t acked = SNAPSHOT_FULL;
+    };
+
+    netSocket listener = NET_BAD_SOCKET;
+    std::vector<Client> clients;
+    // Entities of the last SNAPSHOT_HISTORY ticks, oldest first
+    std::deque<std::pair<std::uint32_t, std::vector<SimEntity>>> history;
+    std::vector<std::uint8_t> payload;
+
+    const std::vector<SimEntity>* entitiesAt(std::uint32_t tick) const
+    {
+        if (tick == SNAPSHOT_FULL || history.empty() || tick < history.front().first || tick > history.back().first) return nullptr;
+        return &history[tick - history.front().first].second;
+    }
+
+    void accept()
+    {
+        while (true)
+        {
+            netSocket s = ::accept(listener, nullptr, nullptr);
+            if (s == NET_BAD_SOCKET) return;
+            netConfigure(s);
+            Client client;
+            client.conn = NetConnection(s);
+            client.entity = sim.AddPlayer();
+            ByteWriter welcome;
+            welcome.u16(client.entity);
+            welcome.u32(ticksPerSecond);
+            client.conn.Queue(NETMSG::WELCOME, welcome.bytes);
+            clients.push_back(std::move(client));
+        }
+    }
+
+    void readInputs(Client& client)
+    {
+        client.conn.Receive();
+        NETMSG type;
+        while (client.conn.Pop(type, payload))
+        {
+            if (type != NETMSG::INPUT) continue;
+            ByteReader in(payload.data(), payload.size());
+            std::uint32_t acked = in.u32();
+            std::uint64_t n = in.varint();
+            // Only the newest direction matters by the time the batch is applied
+            for (std::uint64_t k = 0; k < n && in.ok; k++)
+            {
+                in.u32();
+                std::uint8_t dir = in.u8();
+                if (in.ok) sim.SetInput(client.entity, dir);
+                stats.inputs++;
+            }
+            if (in.ok && acked != SNAPSHOT_FULL && acked <= sim.state.tick) client.acked = acked;
+        }
+    }
+
+public:
+    GameSim sim;
+    std::uint32_t ticksPerSecond = 30;
+    ServerStats stats;
+
+    ~GameServer() { Stop(); }
+
+    // Listens on 127.0.0.1:port (0 = any free port), returns the port or 0 on failure
+    std::uint16_t Start(const TileBlock& tiles, std::uint16_t port, std::uint64_t seed = 1)
+    {
+        sim = GameSim(seed);
+        sim.Load(tiles);
+        history.clear();
+        history.emplace_back(sim.state.tick, sim.state.entities);
+        listener = netListen(port);
+        if (listener == NET_BAD_SOCKET) return 0;
+        return netLocalPort(listener);
+    }
+
+    void Stop()
+    {
+        clients.clear();
+        netClose(listener);
+        listener = NET_BAD_SOCKET;
+    }
+
+    int clientCount() const { return (int)clients.size(); }
+
+    // One server tick: new clients, inputs, a sim step and a snapshot for every client
+    void Tick()
+    {
+        auto start = std::chrono::steady_clock::now();
+        accept();
+        for (Client& client : clients) readInputs(client);
+        for (Client& client : clients)
+        {
+            if (client.conn.closed) sim.RemovePlayer(client.entity);
+        }
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [](const Client& c) { return c.conn.closed; }), clients.end());
+
+        sim.Step();
+        history.emplace_back(sim.state.tick, sim.state.entities);
+        while (history.size() > SNAPSHOT_HISTORY) history.pop_front();
+        // No delta can start before the oldest tick kept
+        sim.PruneChanges(history.front().first);
+
+        SendSnapshots();
+        stats.ticks++;
+        stats.clientTicks += clients.size();
+        stats.busySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Sends every client the current tick (again, if it already has it)
+    void SendSnapshots()
+    {
+        for (Client& client : clients)
+        {
+            if (client.conn.backlog() > NET_MAX_BACKLOG)
+            {
+                stats.skipped++;
+                client.conn.Flush();
+                continue;
+            }
+            const std::vector<SimEntity>* base = entitiesAt(client.acked);
+            ByteWriter snapshot;
+            EncodeSnapshot(sim.state, base, client.acked, sim.changes, snapshot);
+            client.conn.Queue(NETMSG::SNAPSHOT, snapshot.bytes);
+            client.conn.Flush();
+            stats.snapshots++;
+            stats.snapshotBytes += snapshot.bytes.size() + 5;
+            if (base == nullptr) stats.fullSnapshots++;
+        }
+    }
+
+    // Snapshot bytes per tick (all clients), per client, and clients one core could serve at ticksPerSecond
+    std::string getStatsText() const
+    {
+        std::ostringstream ss;
+        ss.precision(1);
+        double ticks = (double)std::max<std::uint64_t>(1, stats.ticks);
+        double perClient = stats.snapshots == 0 ? 0 : (double)stats.snapshotBytes / stats.snapshots;
+        double busyPerClientTick = stats.clientTicks == 0 ? 0 : stats.busySeconds / stats.clientTicks;
+        ss << std::fixed << "server: tick " << sim.state.tick << " | " << clients.size() << " clients | "
+            << stats.snapshotBytes / ticks << " bytes/tick (" << perClient << " per snapshot, "
+            << stats.fullSnapshots << " full, " << stats.skipped << " skipped) | "
+            << stats.busySeconds * 1e6 / ticks << " us/tick";
+        if (busyPerClientTick > 0) ss << " | ~" << (std::uint64_t)(1.0 / (busyPerClientTick * ticksPerSecond)) << " clients/core at " << ticksPerSecond << " Hz";
+        return ss.str();
+    }
+};
+
+// A client that plays by itself: rebuilds the server's state from the snapshots and
+// steers its Pac-Man at random, sending inputs in batches of inputBatch ticks
+class BotClient
+{
+private:
+    NetConnection conn;
+    std::deque<std::pair<std::uint32_t, std::vector<SimEntity>>> history;
+    std::vector<std::pair<std::uint32_t, std::uint8_t>> pendingInputs;
+    MazeRng rng;
+    std::vector<std::uint8_t> payload;
+    // Snapshots since the last input batch
+    int sinceSent = 0;
+
+    const std::vector<SimEntity>* entitiesAt(std::uint32_t tick) const
+    {
+        for (const auto& h : history)
+        {
+            if (h.first == tick) return &h.second;
+        }
+        return nullptr;
+    }
+
+    void sendInputs()
+    {
+        ByteWriter batch;
+        batch.u32(hasState ? state.tick : SNAPSHOT_FULL);
+        batch.varint(pendingInputs.size());
+        for (const auto& input : pendingInputs)
+        {
+            batch.u32(input.first);
+            batch.u8(input.second);
+        }
+        conn.Queue(NETMSG::INPUT, batch.bytes);
+        conn.Flush();
+        pendingInputs.clear();
+    }
+
+public:
+    SimState state;
+    bool hasState = false;
+    bool welcomed = false;
+    std::uint16_t entity = 0;
+    int inputBatch = 4;
+    std::uint64_t snapshots = 0;
+    bool failed = false;
+
+    explicit BotClient(std::uint64_t seed = 1) : rng(seed) {}
+
+    bool Connect(std::uint16_t port)
+    {
+        netSocket s = netConnect(port);
+        if (s == NET_BAD_SOCKET) return false;
+        conn = NetConnection(s);
+        return true;
+    }
+
+    bool isConnected() const { return conn.socket != NET_BAD_SOCKET && !conn.closed; }
+    std::uint64_t bytesReceived() const { return conn.bytesReceived; }
+
+    // Handles everything that arrived, then sends a batch of inputs if one is due
+    void Update()
+    {
+        conn.Receive();
+        NETMSG type;
+        bool gotSnapshot = false;
+        while (conn.Pop(type, payload))
+        {
+            ByteReader in(payload.data(), payload.size());
+            if (type == NETMSG::WELCOME)
+            {
+                entity = in.u16();
+                welcomed = true;
+            }
+            else if (type == NETMSG::SNAPSHOT)
+            {
+                if (!DecodeSnapshot(in, state, [this](std::uint32_t tick) { return entitiesAt(tick); }))
+                {
+                    failed = true;
+                    continue;
+                }
+                hasState = true;
+                gotSnapshot = true;
+                snapshots++;
+                if (history.empty() || history.back().first != state.tick) history.emplace_back(state.tick, state.entities);
+                while (history.size() > SNAPSHOT_HISTORY) history.pop_front();
+            }
+        }
+        if (!gotSnapshot) return;
+
+        // A new direction now and then
+        if (rng.below(8) == 0) pendingInputs.emplace_back(state.tick, (std::uint8_t)rng.below(4));
+        // The first ack goes out at once, until then every snapshot is a full one
+        if (++sinceSent >= inputBatch || snapshots == 1)
+        {
+            sinceSent = 0;
+            sendInputs();
+        }
+    }
+};
@@ -0,0 +1,411 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+#include "MazeGenerator.h"
+#include "TileBlock.h"
+#include "TileTypeDefinitions.h"
+
+// Headless PLAY-mode simulation and its snapshots.
+//
+// Every tick each Pac-Man moves one tile, turning when the direction its client last
+// asked for is open, and eats the coin it lands on. Ghosts (one per ghost spawn) keep
+// going and pick a random open direction at junctions. A Pac-Man caught by a ghost goes
+// back to a player spawn. The sim is deterministic: the state only depends on the map,
+// the seed and the inputs given before each Step().
+//
+// Snapshots are binary: a full one has every tile (run-length coded) and every entity.
+// A delta against an older tick has the tiles changed since then (last value per tile)
+// and the entity fields that differ from that tick's entities. All numbers are varints.
+
+// Directions: up, down, left, right (d ^ 1 is the reverse), SIM_STOP stands still
+const std::uint8_t SIM_STOP = 4;
+const int simDirRow[5] = { -1, 1, 0, 0, 0 };
+const int simDirCol[5] = { 0, 0, -1, 1, 0 };
+// baseTick of a full snapshot
+const std::uint32_t SNAPSHOT_FULL = 0xFFFFFFFFu;
+
+enum class SIMENTITY : std::uint8_t { PACMAN = 0, GHOST = 1 };
+
+struct SimEntity
+{
+    std::uint16_t id = 0;
+    SIMENTITY kind = SIMENTITY::PACMAN;
+    std::uint8_t dir = SIM_STOP;
+    std::int32_t row = 0, col = 0;
+    std::uint32_t score = 0;
+};
+
+// A tile changed on a tick (a coin eaten)
+struct SimTileChange
+{
+    std::uint32_t tick;
+    std::uint32_t pos;
+    std::uint8_t type;
+};
+
+struct SimState
+{
+    std::uint32_t tick = 0;
+    TileBlock tiles;
+    // Sorted by id
+    std::vector<SimEntity> entities;
+
+    // FNV-1a of tiles and entities, to check that a client rebuilt the server's state exactly
+    std::uint64_t Hash() const
+    {
+        std::uint64_t h = 1469598103934665603ull;
+        auto mix = [&h](std::uint64_t v) { h = (h ^ v) * 1099511628211ull; };
+        mix(tick);
+        for (std::uint8_t t : tiles.tiles) mix(t);
+        for (const SimEntity& e : entities)
+        {
+            mix(e.id);
+            mix((std::uint64_t)e.kind);
+            mix(e.dir);
+            mix((std::uint32_t)e.row);
+            mix((std::uint32_t)e.col);
+            mix(e.score);
+        }
+        return h;
+    }
+};
+
+struct ByteWriter
+{
+    std::vector<std::uint8_t> bytes;
+
+    void u8(std::uint8_t v) { bytes.push_back(v); }
+    void u16(std::uint16_t v) { u8((std::uint8_t)v); u8((std::uint8_t)(v >> 8)); }
+    void u32(std::uint32_t v) { u16((std::uint16_t)v); u16((std::uint16_t)(v >> 16)); }
+    void varint(std::uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            u8((std::uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        u8((std::uint8_t)v);
+    }
+};
+
+// Reads past the end give 0 and clear ok
+struct ByteReader
+{
+    const std::uint8_t* p;
+    const std::uint8_t* end;
+    bool ok = true;
+
+    ByteReader(const std::uint8_t* data, std::size_t size) : p(data), end(data + size) {}
+
+    std::uint8_t u8()
+    {
+        if (p >= end)
+        {
+            ok = false;
+            return 0;
+        }
+        return *p++;
+    }
+    std::uint16_t u16() { std::uint16_t lo = u8(); return (std::uint16_t)(lo | (u8() << 8)); }
+    std::uint32_t u32() { std::uint32_t lo = u16(); return lo | ((std::uint32_t)u16() << 16); }
+    std::uint64_t varint()
+    {
+        std::uint64_t v = 0;
+        for (int shift = 0; shift < 64 && ok; shift += 7)
+        {
+            std::uint8_t b = u8();
+            v |= (std::uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+};
+
+class GameSim
+{
+private:
+    MazeRng rng;
+    std::vector<std::uint32_t> playerSpawns;
+    // Direction each Pac-Man's client asked for, by id
+    std::vector<std::uint8_t> wanted;
+    std::uint16_t nextId = 0;
+
+    static const std::uint8_t WALL = (std::uint8_t)TILETYPE::WALL;
+    static const std::uint8_t COIN = (std::uint8_t)TILETYPE::COIN;
+
+    bool open(int r, int c) const
+    {
+        return r >= 0 && r < state.tiles.rows && c >= 0 && c < state.tiles.cols && state.tiles.get(r, c) != WALL;
+    }
+    bool open(const SimEntity& e, std::uint8_t d) const { return d != SIM_STOP && open(e.row + simDirRow[d], e.col + simDirCol[d]); }
+
+    std::uint16_t add(SIMENTITY kind, std::uint32_t pos)
+    {
+        SimEntity e;
+        e.id = nextId++;
+        e.kind = kind;
+        e.row = (std::int32_t)(pos / state.tiles.cols);
+        e.col = (std::int32_t)(pos % state.tiles.cols);
+        state.entities.push_back(e);
+        wanted.push_back(SIM_STOP);
+        return e.id;
+    }
+
+    void moveGhost(SimEntity& e)
+    {
+        std::uint8_t reverse = e.dir == SIM_STOP ? SIM_STOP : (std::uint8_t)(e.dir ^ 1);
+        std::uint8_t options[4];
+        int n = 0;
+        for (std::uint8_t d = 0; d < 4; d++)
+        {
+            if (d != reverse && open(e, d)) options[n++] = d;
+        }
+        // Dead end: turn around. Junction or blocked: pick a way.
+        if (n == 0) e.dir = open(e, reverse) ? reverse : SIM_STOP;
+        else if (n > 1 || !open(e, e.dir)) e.dir = options[rng.below(n)];
+        if (open(e, e.dir))
+        {
+            e.row += simDirRow[e.dir];
+            e.col += simDirCol[e.dir];
+        }
+    }
+
+    void movePacman(SimEntity& e)
+    {
+        if (open(e, wanted[e.id])) e.dir = wanted[e.id];
+        if (!open(e, e.dir)) return;
+        e.row += simDirRow[e.dir];
+        e.col += simDirCol[e.dir];
+        if (state.tiles.get(e.row, e.col) == COIN)
+        {
+            state.tiles.set(e.row, e.col, (std::uint8_t)TILETYPE::BLANK);
+            changes.push_back({ state.tick, (std::uint32_t)(e.row * state.tiles.cols + e.col), (std::uint8_t)TILETYPE::BLANK });
+            e.score++;
+        }
+    }
+
+public:
+    SimState state;
+    // Tile changes, oldest first, until PruneChanges drops them
+    std::vector<SimTileChange> changes;
+
+    explicit GameSim(std::uint64_t seed = 1) : rng(seed) {}
+
+    // Starts on a map: a ghost on every ghost spawn, Pac-Men join with AddPlayer
+    void Load(const TileBlock& tiles)
+    {
+        state = SimState();
+        state.tiles = tiles;
+        changes.clear();
+        playerSpawns.clear();
+        wanted.clear();
+        nextId = 0;
+        std::uint32_t firstOpen = 0;
+        bool foundOpen = false;
+        for (std::uint32_t pos = 0; pos < (std::uint32_t)tiles.tiles.size(); pos++)
+        {
+            std::uint8_t t = tiles.tiles[pos];
+            if (t == (std::uint8_t)TILETYPE::PLAYERSPAWN) playerSpawns.push_back(pos);
+            else if (t == (std::uint8_t)TILETYPE::GHOSTSPAWN) add(SIMENTITY::GHOST, pos);
+            if (t != WALL && !foundOpen)
+            {
+                firstOpen = pos;
+                foundOpen = true;
+            }
+        }
+        if (playerSpawns.empty()) playerSpawns.push_back(firstOpen);
+    }
+
+    std::uint16_t AddPlayer() { return add(SIMENTITY::PACMAN, playerSpawns[nextId % playerSpawns.size()]); }
+
+    void RemovePlayer(std::uint16_t id)
+    {
+        state.entities.erase(std::remove_if(state.entities.begin(), state.entities.end(),
+            [id](const SimEntity& e) { return e.id == id; }), state.entities.end());
+    }
+
+    void SetInput(std::uint16_t id, std::uint8_t dir)
+    {
+        if (id < wanted.size() && dir <= SIM_STOP) wanted[id] = dir;
+    }
+
+    void Step()
+    {
+        state.tick++;
+        for (SimEntity& e : state.entities)
+        {
+            if (e.kind == SIMENTITY::GHOST) moveGhost(e);
+            else movePacman(e);
+        }
+        for (SimEntity& e : state.entities)
+        {
+            if (e.kind != SIMENTITY::PACMAN) continue;
+            for (const SimEntity& g : state.entities)
+            {
+                if (g.kind != SIMENTITY::GHOST || g.row != e.row || g.col != e.col) continue;
+                std::uint32_t spawn = playerSpawns[e.id % playerSpawns.size()];
+                e.row = (std::int32_t)(spawn / state.tiles.cols);
+                e.col = (std::int32_t)(spawn % state.tiles.cols);
+                e.dir = SIM_STOP;
+                break;
+            }
+        }
+    }
+
+    // Drops the tile changes made on or before tick (no client needs a delta from before it)
+    void PruneChanges(std::uint32_t tick)
+    {
+        auto it = std::find_if(changes.begin(), changes.end(), [tick](const SimTileChange& c) { return c.tick > tick; });
+        changes.erase(changes.begin(), it);
+    }
+};
+
+// Field bits of an entity record in a snapshot
+const std::uint8_t ENTITY_KIND = 1, ENTITY_ROW = 2, ENTITY_COL = 4, ENTITY_DIR = 8, ENTITY_SCORE = 16;
+
+// Writes state as a delta against base (the entities at baseTick, and every tile change
+// after baseTick), or as a full snapshot when base is nullptr
+inline void EncodeSnapshot(const SimState& state, const std::vector<SimEntity>* base, std::uint32_t baseTick,
+    const std::vector<SimTileChange>& changes, ByteWriter& out)
+{
+    static const std::vector<SimEntity> none;
+    out.u32(state.tick);
+    out.u32(base == nullptr ? SNAPSHOT_FULL : baseTick);
+    if (base == nullptr)
+    {
+        const std::vector<std::uint8_t>& t = state.tiles.tiles;
+        out.varint((std::uint64_t)state.tiles.rows);
+        out.varint((std::uint64_t)state.tiles.cols);
+        for (std::size_t i = 0; i < t.size();)
+        {
+            std::size_t run = 1;
+            while (i + run < t.size() && t[i + run] == t[i]) run++;
+            out.varint(run);
+            out.u8(t[i]);
+            i += run;
+        }
+        base = &none;
+    }
+    else
+    {
+        // Newest change of every tile changed since baseTick
+        std::vector<const SimTileChange*> newest;
+        std::unordered_set<std::uint32_t> seen;
+        for (auto it = changes.rbegin(); it != changes.rend() && it->tick > baseTick; ++it)
+        {
+            if (seen.insert(it->pos).second) newest.push_back(&*it);
+        }
+        out.varint(newest.size());
+        for (const SimTileChange* c : newest)
+        {
+            out.varint(c->pos);
+            out.u8(c->type);
+        }
+    }
+
+    // Both lists are sorted by id
+    ByteWriter records;
+    std::size_t changed = 0, b = 0;
+    std::vector<std::uint16_t> removed;
+    for (const SimEntity& e : state.entities)
+    {
+        while (b < base->size() && (*base)[b].id < e.id) removed.push_back((*base)[b++].id);
+        const SimEntity* old = b < base->size() && (*base)[b].id == e.id ? &(*base)[b++] : nullptr;
+        std::uint8_t mask = old == nullptr ? 0x1F : 0;
+        if (old != nullptr)
+        {
+            if (old->kind != e.kind) mask |= ENTITY_KIND;
+            if (old->row != e.row) mask |= ENTITY_ROW;
+            if (old->col != e.col) mask |= ENTITY_COL;
+            if (old->dir != e.dir) mask |= ENTITY_DIR;
+            if (old->score != e.score) mask |= ENTITY_SCORE;
+        }
+        if (mask == 0) continue;
+        changed++;
+        records.u16(e.id);
+        records.u8(mask);
+        if (mask & ENTITY_KIND) records.u8((std::uint8_t)e.kind);
+        if (mask & ENTITY_ROW) records.varint((std::uint32_t)e.row);
+        if (mask & ENTITY_COL) records.varint((std::uint32_t)e.col);
+        if (mask & ENTITY_DIR) records.u8(e.dir);
+        if (mask & ENTITY_SCORE) records.varint(e.score);
+    }
+    while (b < base->size()) removed.push_back((*base)[b++].id);
+
+    out.varint(changed);
+    out.bytes.insert(out.bytes.end(), records.bytes.begin(), records.bytes.end());
+    out.varint(removed.size());
+    for (std::uint16_t id : removed) out.u16(id);
+}
+
+// Applies a snapshot to state. entitiesAt gives the entities the client kept for a tick
+// (nullptr if it has not got them). Returns false if the snapshot is malformed or its base is unknown.
+inline bool DecodeSnapshot(ByteReader& in, SimState& state, const std::function<const std::vector<SimEntity>*(std::uint32_t)>& entitiesAt)
+{
+    std::uint32_t tick = in.u32();
+    std::uint32_t baseTick = in.u32();
+    std::vector<SimEntity> entities;
+    if (baseTick == SNAPSHOT_FULL)
+    {
+        int rows = (int)in.varint(), cols = (int)in.varint();
+        if (!in.ok || rows < 0 || cols < 0) return false;
+        state.tiles.Create(rows, cols);
+        std::size_t i = 0;
+        while (i < state.tiles.tiles.size() && in.ok)
+        {
+            std::uint64_t run = in.varint();
+            std::uint8_t t = in.u8();
+            if (run == 0 || run > state.tiles.tiles.size() - i) return false;
+            std::fill_n(state.tiles.tiles.begin() + i, (std::size_t)run, t);
+            i += (std::size_t)run;
+        }
+    }
+    else
+    {
+        const std::vector<SimEntity>* base = entitiesAt(baseTick);
+        if (base == nullptr) return false;
+        entities = *base;
+        // Tiles are newest values, so applying them over a state newer than baseTick is fine
+        std::uint64_t n = in.varint();
+        for (std::uint64_t k = 0; k < n && in.ok; k++)
+        {
+            std::uint64_t pos = in.varint();
+            std::uint8_t t = in.u8();
+            if (pos >= state.tiles.tiles.size()) return false;
+            state.tiles.tiles[(std::size_t)pos] = t;
+        }
+    }
+
+    std::uint64_t changed = in.varint();
+    for (std::uint64_t k = 0; k < changed && in.ok; k++)
+    {
+        std::uint16_t id = in.u16();
+        std::uint8_t mask = in.u8();
+        auto it = std::lower_bound(entities.begin(), entities.end(), id, [](const SimEntity& e, std::uint16_t v) { return e.id < v; });
+        if (it == entities.end() || it->id != id)
+        {
+            SimEntity e;
+            e.id = id;
+            it = entities.insert(it, e);
+        }
+        if (mask & ENTITY_KIND) it->kind = (SIMENTITY)in.u8();
+        if (mask & ENTITY_ROW) it->row = (std::int32_t)in.varint();
+        if (mask & ENTITY_COL) it->col = (std::int32_t)in.varint();
+        if (mask & ENTITY_DIR) it->dir = in.u8();
+        if (mask & ENTITY_SCORE) it->score = (std::uint32_t)in.varint();
+    }
+    std::uint64_t removed = in.varint();
+    for (std::uint64_t k = 0; k < removed && in.ok; k++)
+    {
+        std::uint16_t id = in.u16();
+        entities.erase(std::remove_if(entities.begin(), entities.end(), [id](const SimEntity& e) { return e.id == id; }), entities.end());
+    }
+    if (!in.ok) return false;
+    state.tick = tick;
+    state.entities = std::move(entities);
+    return true;
+}
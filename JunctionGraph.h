@@ -0,0 +1,430 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <vector>
+
+// Corridor-contracted pathfinding graph.
+//
+// Pac-Man mazes are mostly one tile wide corridors. Every walkable tile that does not
+// have exactly two walkable neighbours (junctions, dead ends, open areas) is a node,
+// and each run of two-neighbour tiles between two nodes is one weighted edge (a corridor).
+// Every tile maps to its node, or to its corridor and offset along it, so queries
+// start and end anywhere but only search the contracted graph.
+//
+// Tiles are indexed row * cols + col. Directions: 0 up, 1 down, 2 left, 3 right.
+
+class JunctionGraph
+{
+public:
+    struct Node
+    {
+        int tile = -1;
+        // Corridor leaving in each direction (-1 if none)
+        std::array<int, 4> edge = { -1, -1, -1, -1 };
+        bool alive = false;
+    };
+
+    struct Corridor
+    {
+        // End nodes, and the direction the corridor leaves each of them in
+        int a = -1, b = -1;
+        int dirA = -1, dirB = -1;
+        // Tiles strictly between a and b, in order from a to b
+        std::vector<int> tiles;
+        bool alive = false;
+
+        int length() const { return (int)tiles.size() + 1; }
+    };
+
+    struct PathResult
+    {
+        // Steps from start to goal, -1 if unreachable
+        int distance = -1;
+        // Tiles from start to goal inclusive (only if asked for)
+        std::vector<int> tiles;
+    };
+
+    int rows = 0, cols = 0;
+    std::vector<std::uint8_t> walkable;
+    std::vector<int> tileNode;
+    std::vector<int> tileCorridor;
+    std::vector<int> tileOffset;
+    std::vector<Node> nodes;
+    std::vector<Corridor> corridors;
+    int liveNodes = 0;
+    int liveCorridors = 0;
+
+private:
+    std::vector<int> freeNodes;
+    std::vector<int> freeCorridors;
+    // End nodes of corridors removed by an edit, to retrace
+    std::vector<int> pendingNodes;
+
+    // Query scratch, reset through touched so queries stay O(visited)
+    std::vector<int> g;
+    std::vector<int> parentNode;
+    std::vector<int> parentEdge;
+    std::vector<std::int8_t> sourceSide;
+    std::vector<int> touched;
+
+    static int opposite(int d) { return d ^ 1; }
+
+    int neighbour(int tile, int d) const
+    {
+        int r = tile / cols, c = tile % cols;
+        switch (d)
+        {
+        case 0: return r > 0 ? tile - cols : -1;
+        case 1: return r < rows - 1 ? tile + cols : -1;
+        case 2: return c > 0 ? tile - 1 : -1;
+        default: return c < cols - 1 ? tile + 1 : -1;
+        }
+    }
+
+    bool open(int tile, int d) const
+    {
+        int nb = neighbour(tile, d);
+        return nb != -1 && walkable[nb];
+    }
+
+    int degree(int tile) const
+    {
+        return (int)open(tile, 0) + open(tile, 1) + open(tile, 2) + open(tile, 3);
+    }
+
+    int addNode(int tile)
+    {
+        int id;
+        if (!freeNodes.empty()) { id = freeNodes.back(); freeNodes.pop_back(); }
+        else { id = (int)nodes.size(); nodes.emplace_back(); }
+        nodes[id] = Node();
+        nodes[id].tile = tile;
+        nodes[id].alive = true;
+        tileNode[tile] = id;
+        liveNodes++;
+        return id;
+    }
+
+    void removeCorridor(int id)
+    {
+        Corridor& c = corridors[id];
+        if (!c.alive) return;
+        for (int t : c.tiles) tileCorridor[t] = -1;
+        if (nodes[c.a].edge[c.dirA] == id) nodes[c.a].edge[c.dirA] = -1;
+        if (nodes[c.b].edge[c.dirB] == id) nodes[c.b].edge[c.dirB] = -1;
+        pendingNodes.push_back(c.a);
+        pendingNodes.push_back(c.b);
+        c.alive = false;
+        c.tiles.clear();
+        freeCorridors.push_back(id);
+        liveCorridors--;
+    }
+
+    void removeNode(int id)
+    {
+        for (int d = 0; d < 4; d++)
+        {
+            if (nodes[id].edge[d] != -1) removeCorridor(nodes[id].edge[d]);
+        }
+        tileNode[nodes[id].tile] = -1;
+        nodes[id].alive = false;
+        freeNodes.push_back(id);
+        liveNodes--;
+    }
+
+    // Walks from node n in direction d to the next node and records the corridor
+    void trace(int n, int d)
+    {
+        int id;
+        if (!freeCorridors.empty()) { id = freeCorridors.back(); freeCorridors.pop_back(); }
+        else { id = (int)corridors.size(); corridors.emplace_back(); }
+        Corridor& c = corridors[id];
+        c.a = n;
+        c.dirA = d;
+        c.tiles.clear();
+        c.alive = true;
+        liveCorridors++;
+
+        int prev = nodes[n].tile;
+        int cur = neighbour(prev, d);
+        int moved = d;
+        while (tileNode[cur] == -1)
+        {
+            // Only two-neighbour tiles are not nodes
+            tileCorridor[cur] = id;
+            tileOffset[cur] = (int)c.tiles.size();
+            c.tiles.push_back(cur);
+            for (int k = 0; k < 4; k++)
+            {
+                int nb = neighbour(cur, k);
+                if (nb != -1 && walkable[nb] && nb != prev)
+                {
+                    prev = cur;
+                    cur = nb;
+                    moved = k;
+                    break;
+                }
+            }
+        }
+        c.b = tileNode[cur];
+        c.dirB = opposite(moved);
+        nodes[c.a].edge[c.dirA] = id;
+        nodes[c.b].edge[c.dirB] = id;
+    }
+
+    void traceOpenEdges(int n)
+    {
+        if (!nodes[n].alive) return;
+        for (int d = 0; d < 4; d++)
+        {
+            if (nodes[n].edge[d] == -1 && open(nodes[n].tile, d)) trace(n, d);
+        }
+    }
+
+    // Corridor tiles not reachable from any node form closed loops, give each one a node
+    void anchorLoop(int tile)
+    {
+        if (!walkable[tile] || tileNode[tile] != -1 || tileCorridor[tile] != -1) return;
+        traceOpenEdges(addNode(tile));
+    }
+
+    void resetScratch()
+    {
+        for (int n : touched)
+        {
+            g[n] = INT_MAX;
+            parentNode[n] = -1;
+            parentEdge[n] = -1;
+        }
+        touched.clear();
+        if (g.size() < nodes.size())
+        {
+            g.resize(nodes.size(), INT_MAX);
+            parentNode.resize(nodes.size(), -1);
+            parentEdge.resize(nodes.size(), -1);
+            sourceSide.resize(nodes.size(), 0);
+        }
+    }
+
+    // Nodes a tile can reach directly: {node, steps, side (0 = towards corridor a, 1 = towards b)}
+    int anchorsOf(int tile, std::array<std::array<int, 3>, 2>& out) const
+    {
+        if (tileNode[tile] != -1)
+        {
+            out[0] = { tileNode[tile], 0, 0 };
+            return 1;
+        }
+        const Corridor& c = corridors[tileCorridor[tile]];
+        int k = tileOffset[tile];
+        out[0] = { c.a, k + 1, 0 };
+        out[1] = { c.b, c.length() - (k + 1), 1 };
+        return 2;
+    }
+
+    bool deadEnd(int n) const
+    {
+        const Node& node = nodes[n];
+        return (node.edge[0] != -1) + (node.edge[1] != -1) + (node.edge[2] != -1) + (node.edge[3] != -1) <= 1;
+    }
+
+    int manhattan(int a, int b) const
+    {
+        return std::abs(a / cols - b / cols) + std::abs(a % cols - b % cols);
+    }
+
+    // Appends the tiles walked going from `tile` (inside corridor c) to its end on `side`, excluding tile
+    void walkCorridor(const Corridor& c, int from, int side, std::vector<int>& out) const
+    {
+        if (side == 0)
+        {
+            for (int i = from - 1; i >= 0; i--) out.push_back(c.tiles[i]);
+            out.push_back(nodes[c.a].tile);
+        }
+        else
+        {
+            for (int i = from + 1; i < (int)c.tiles.size(); i++) out.push_back(c.tiles[i]);
+            out.push_back(nodes[c.b].tile);
+        }
+    }
+
+public:
+    bool isBuilt() const { return rows > 0 && cols > 0; }
+
+    void Clear()
+    {
+        *this = JunctionGraph();
+    }
+
+    // Builds the graph from a walkability grid (1 = walkable), row major
+    void Build(int _rows, int _cols, std::vector<std::uint8_t> _walkable)
+    {
+        Clear();
+        rows = _rows;
+        cols = _cols;
+        walkable = std::move(_walkable);
+        tileNode.assign(walkable.size(), -1);
+        tileCorridor.assign(walkable.size(), -1);
+        tileOffset.assign(walkable.size(), 0);
+
+        for (int t = 0; t < (int)walkable.size(); t++)
+        {
+            if (walkable[t] && degree(t) != 2) addNode(t);
+        }
+        for (int n = 0; n < (int)nodes.size(); n++) traceOpenEdges(n);
+        for (int t = 0; t < (int)walkable.size(); t++) anchorLoop(t);
+        pendingNodes.clear();
+    }
+
+    // Changes one tile and rebuilds only the corridors through it and its neighbours
+    void SetWalkable(int r, int c, bool isWalkable)
+    {
+        int tile = r * cols + c;
+        if ((bool)walkable[tile] == isWalkable) return;
+        walkable[tile] = isWalkable;
+
+        // Only the tile and its neighbours change degree
+        std::array<int, 5> dirty = { tile, neighbour(tile, 0), neighbour(tile, 1), neighbour(tile, 2), neighbour(tile, 3) };
+        for (int t : dirty)
+        {
+            if (t == -1) continue;
+            if (tileCorridor[t] != -1) removeCorridor(tileCorridor[t]);
+            if (tileNode[t] != -1) removeNode(tileNode[t]);
+        }
+        for (int t : dirty)
+        {
+            if (t != -1 && walkable[t] && degree(t) != 2) addNode(t);
+        }
+        for (int t : dirty)
+        {
+            if (t != -1 && tileNode[t] != -1) traceOpenEdges(tileNode[t]);
+        }
+        for (int n : pendingNodes) traceOpenEdges(n);
+        pendingNodes.clear();
+        for (int t : dirty)
+        {
+            if (t != -1) anchorLoop(t);
+        }
+    }
+
+    // A* over junctions from tile start to tile goal
+    PathResult FindPath(int start, int goal, bool withTiles = false)
+    {
+        PathResult result;
+        if (!walkable[start] || !walkable[goal]) return result;
+        if (start == goal)
+        {
+            result.distance = 0;
+            if (withTiles) result.tiles.push_back(start);
+            return result;
+        }
+        resetScratch();
+
+        std::array<std::array<int, 3>, 2> starts, goals;
+        int startCount = anchorsOf(start, starts);
+        int goalCount = anchorsOf(goal, goals);
+
+        // Same corridor: walking straight along it is a candidate
+        int best = INT_MAX;
+        bool direct = false;
+        if (tileCorridor[start] != -1 && tileCorridor[start] == tileCorridor[goal])
+        {
+            best = std::abs(tileOffset[start] - tileOffset[goal]);
+            direct = true;
+        }
+
+        // {f, -g, node}: on equal f the deepest node goes first
+        using Entry = std::array<int, 3>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+        for (int i = 0; i < startCount; i++)
+        {
+            int n = starts[i][0];
+            if (starts[i][1] < g[n])
+            {
+                if (g[n] == INT_MAX) touched.push_back(n);
+                g[n] = starts[i][1];
+                sourceSide[n] = (std::int8_t)starts[i][2];
+                open.push({ g[n] + manhattan(nodes[n].tile, goal), -g[n], n });
+            }
+        }
+
+        int bestNode = -1, bestSide = 0;
+        while (!open.empty())
+        {
+            Entry e = open.top();
+            open.pop();
+            int n = e[2];
+            if (e[0] >= best) break;
+            if (-e[1] != g[n]) continue; // stale
+
+            for (int i = 0; i < goalCount; i++)
+            {
+                if (goals[i][0] == n && g[n] + goals[i][1] < best)
+                {
+                    best = g[n] + goals[i][1];
+                    bestNode = n;
+                    bestSide = goals[i][2];
+                    direct = false;
+                }
+            }
+            for (int d = 0; d < 4; d++)
+            {
+                int id = nodes[n].edge[d];
+                if (id == -1) continue;
+                const Corridor& c = corridors[id];
+                int other = (c.a == n && c.dirA == d) ? c.b : c.a;
+                int ng = g[n] + c.length();
+                // Dead ends lead nowhere unless the goal is in them
+                if (other != goals[0][0] && other != goals[goalCount - 1][0] && deadEnd(other)) continue;
+                if (ng < g[other])
+                {
+                    if (g[other] == INT_MAX) touched.push_back(other);
+                    g[other] = ng;
+                    parentNode[other] = n;
+                    parentEdge[other] = id;
+                    open.push({ ng + manhattan(nodes[other].tile, goal), -ng, other });
+                }
+            }
+        }
+
+        if (best == INT_MAX) return result;
+        result.distance = best;
+        if (!withTiles) return result;
+
+        // Rebuild the tile path
+        result.tiles.push_back(start);
+        if (direct)
+        {
+            const Corridor& c = corridors[tileCorridor[start]];
+            int step = tileOffset[goal] > tileOffset[start] ? 1 : -1;
+            for (int i = tileOffset[start] + step; i != tileOffset[goal] + step; i += step) result.tiles.push_back(c.tiles[i]);
+            return result;
+        }
+
+        std::vector<int> chain;
+        for (int n = bestNode; n != -1; n = parentNode[n]) chain.push_back(n);
+        std::reverse(chain.begin(), chain.end());
+
+        if (tileCorridor[start] != -1) walkCorridor(corridors[tileCorridor[start]], tileOffset[start], sourceSide[chain[0]], result.tiles);
+        for (std::size_t i = 1; i < chain.size(); i++)
+        {
+            const Corridor& c = corridors[parentEdge[chain[i]]];
+            if (c.a == chain[i - 1]) { for (int t : c.tiles) result.tiles.push_back(t); }
+            else { for (auto it = c.tiles.rbegin(); it != c.tiles.rend(); ++it) result.tiles.push_back(*it); }
+            result.tiles.push_back(nodes[chain[i]].tile);
+        }
+        if (tileCorridor[goal] != -1)
+        {
+            // Walk into the goal's corridor from its end on bestSide
+            const Corridor& c = corridors[tileCorridor[goal]];
+            int k = tileOffset[goal];
+            if (bestSide == 0) { for (int i = 0; i <= k; i++) result.tiles.push_back(c.tiles[i]); }
+            else { for (int i = (int)c.tiles.size() - 1; i >= k; i--) result.tiles.push_back(c.tiles[i]); }
+        }
+        return result;
+    }
+};
@@ -8,8 +8,17 @@
 #include <string>
 #include <chrono>
 #include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <random>
+// windows.h would otherwise define min/max macros that break every std::min/std::max after it
+#define NOMINMAX
+// Before windows.h, which otherwise pulls in the old winsock.h (GameServer.h)
+#include <winsock2.h>
 #include <windows.h>
 #include <commdlg.h>
+// Opt-in allocation tracking (build with TRACK_ALLOCATIONS), hooks global new/delete
+#include "AllocTracker.h"
 // File dialogs (windows only)
 #include "resource.h"
 #include "Win32FileDialogs.h"
@@ -20,10 +29,64 @@
 
 #include "Camera.h"
 
+// Out-of-core chunked map storage (.pmap)
+#include "MapPager.h"
+// Bit-packed in-memory tile grid
+#include "PackedTileGrid.h"
+// Dense tile rectangles (clipboard, region ops)
+#include "TileBlock.h"
+// Background autosave journal
+#include "MapJournal.h"
+// Map diff/patch/merge
+#include "MapDiff.h"
+// CPU map to image export
+#include "MapExport.h"
+// Corridor-contracted pathfinding graph
+#include "JunctionGraph.h"
+// Shared texture for many small images (menu icons)
+#include "TextureAtlas.h"
+// Seeded Pac-Man maze generator
+#include "MazeGenerator.h"
+// Tile geometry and minimap built on worker threads
+#include "TileMesh.h"
+// Flip/rotate/transpose and symmetry painting
+#include "MapTransforms.h"
+// Parallel CSV saving through a temp file
+#include "CsvWriter.h"
+// Positions of every tile of each type
+#include "TileTypeIndex.h"
+// Headless game server, bot client and their snapshots
+#include "GameServer.h"
+// Indexed catalogue of the maps in a directory
+#include "MapCatalogue.h"
+// Structure-of-arrays entities and their batched, animated sprites (PLAY mode)
+#include "EntityStore.h"
+// Parallel histogram, replace-all and masked set over the map or a selection
+#include "BulkOps.h"
+
 // Debug/play toggle
 enum class MODE {DEBUG, PLAY};
 MODE game_MODE = MODE::DEBUG;
 
+// Where a map keeps its tiles
+// POINTERGRID: one Tile object per cell in memory (Tile* access through get/set)
+// PACKED: bit-packed blocks in memory, blank blocks not allocated (getType/setType only)
+// PAGED: chunks of a .pmap file paged in around the camera (getType/setType only)
+enum class MAPSTORAGE { POINTERGRID, PACKED, PAGED };
+// Layout used for maps created/opened from the menu (toggle with L)
+MAPSTORAGE newMapStorage = MAPSTORAGE::POINTERGRID;
+// Smallest packing that fits every tile type
+using PackedTileGrid = PackedTileGridT<(TILETYPE_LEN <= 4 ? 2 : (TILETYPE_LEN <= 16 ? 4 : 8))>;
+// Maps with more tiles than this are created as paged maps
+const long long MAX_INMEMORY_TILES = 16LL * 1024 * 1024;
+// Seconds between autosave checkpoints
+const float AUTOSAVE_INTERVAL = 10;
+// Tiles written through WriteRow in one frame that the path graph patches in place,
+// past that it is cheaper to rebuild it once
+const int PATH_PATCH_TILES = 256;
+// PLAY mode sim ticks per second (Pac-Man and the ghosts move one tile per tick)
+const float PLAY_TICKS_PER_SECOND = 8;
+
 
 struct InputHandling {
 public:
@@ -41,10 +104,39 @@ public:
     bool shiftIsHeld = false;
 
     float mouseScoll = 0;
+    // Mouse position in window pixels, sampled once at the start of every frame
+    sf::Vector2i mousePos;
     sf::Vector2f cameraMovAxis;
 
     TILETYPE tileType;
 
+    // Clipboard commands (Ctrl+C, Ctrl+X, Ctrl+V, Esc), cleared once the map has handled them
+    bool copyRequested = false;
+    bool cutRequested = false;
+    bool pasteRequested = false;
+    bool cancelRequested = false;
+    // Stamp mode (T): pasting keeps the clipboard on the mouse for repeated pastes
+    bool stampMode = false;
+    // Path tool (F): set the path start at the mouse, pressed again to turn it off
+    bool pathRequested = false;
+    // Ctrl+G: replace the map with a generated maze of the same size
+    bool generateRequested = false;
+    // K: count the tile types of the selection (or map). J: every tile of the type under the
+    // mouse becomes the selected type, Shift+J only on the map border.
+    bool histogramRequested = false;
+    bool replaceRequested = false;
+    bool replaceOnBorder = false;
+    // F5: switch between editing and PLAY mode
+    bool playToggleRequested = false;
+    // Arrow keys in PLAY mode, a GameSim direction
+    std::uint8_t playDirection = SIM_STOP;
+    // Mirror painting (M cycles off/horizontal/vertical/both)
+    SYMMETRY symmetry = SYMMETRY::NONE;
+    // H, V, R (Shift+R counter-clockwise), Ctrl+T: transform the clipboard while pasting,
+    // else the selection, else the whole map
+    bool transformRequested = false;
+    MAPTRANSFORM transform = MAPTRANSFORM::FLIP_H;
+
     void stopAll()
     {
         cameraMovAxis = sf::Vector2f(0, 0);
@@ -78,6 +170,7 @@ public:
 
     void DrawText(std::string s, int x, int y, int fontSize = 24, sf::Color _color=sf::Color::White)
     {
+        ALLOC_SCOPE("DrawText");
         sf::Text text = sf::Text(font, s);
         //text.setFont(font);
         text.setCharacterSize(fontSize);     // in pixels
@@ -100,13 +193,18 @@ bool parseNumber(std::string s, int& mod)
         return false;
     }
 }
+
+// True if path ends with ext (ext includes the dot, ex. ".pmap")
+bool hasExtension(const std::string& path, const std::string& ext)
+{
+    return path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
 //Forward declaration
 class Tile;
 // Just exposes needed for tile
 class MapSuper
 {
     public:
-        virtual void setSpecialLocVars(int index, sf::Vector2f value) = 0;
         virtual Tile* get(int r, int c) = 0;
         virtual int getWidth() = 0;
         virtual int getHeight() = 0;
@@ -124,13 +222,6 @@ class Tile
             this->tileType = _t;
             this->row = _r;
             this->col = _c;
-            // Handle special tile id (update the pointers of the grid)
-            // (also raise error if already exists)
-            if ((int)_t > 1)
-            {
-                // Set the loc var
-                map->setSpecialLocVars((int)_t, sf::Vector2f(_c, _r));
-            }
         }
         
         /*
@@ -181,43 +272,115 @@ public:
     int mapWidth;
     int mapHeight;
     bool isInitialized = false;
+    MAPSTORAGE storage = MAPSTORAGE::POINTERGRID;
     std::vector<Tile*> grid;
+    // Tiles for MAPSTORAGE::PACKED
+    PackedTileGrid packed;
+    // Backing file for MAPSTORAGE::PAGED
+    MapPager pager;
+    // File this map was loaded from/saved to ("" for new maps)
+    std::string filePath;
+
+    // Edit counter of every CHUNK_SIZE x CHUNK_SIZE region, bumped by every write
+    std::vector<std::uint32_t> chunkRevision;
+    int revisionChunksX = 0;
+    // Autosave: chunkRevision as of the last checkpoint handed to the journal
+    AutosaveJournal journal;
+    std::vector<std::uint32_t> journaledRevision;
+    // chunkRevision as of the last load or save, anything past it is unsaved
+    std::vector<std::uint32_t> savedRevision;
+    float autosaveTimer = 0;
 
     
     // Tilesheet sprites
     std::array<sf::Texture, tileTypeString.size()> tiletype_Textures;
+    // Average color of each tile texture (for one pixel per tile previews)
+    std::array<sf::Color, tileTypeString.size()> tiletype_Colors;
+    // All tile textures in one, for the region meshes
+    TextureAtlas tileAtlas;
+    // Region meshes and minimap, rebuilt off the main thread when chunkRevision changes
+    TileMeshCache meshCache;
+    // Next region UpdateMeshes checks for a stale minimap
+    int minimapCursor = 0;
 
     // Top left corner on screen to start drawing from
     sf::Vector2f screenPos; 
-    Tile* lastPlaced;
-
-    // Spawn positions
-    sf::Vector2f playerSpawnPos;
-    sf::Vector2f pinkSpawnPos;
-    sf::Vector2f redSpawnPos;
-    sf::Vector2f orangeSpawnPos;
-    sf::Vector2f blueSpawnPos;
-
-    // need to initilaize 
-
-    std::array<sf::Vector2f*, 7> specialVars = { nullptr, nullptr, &playerSpawnPos, &redSpawnPos, &blueSpawnPos, &orangeSpawnPos, &pinkSpawnPos};
+    // {row, col} of the last placed tile ({-1,-1} if none)
+    std::array<int, 2> lastPlaced = { -1, -1 };
+
+    // Rectangular selection {row0, col0, row1, col1} (inclusive), made by right click dragging
+    bool hasSelection = false;
+    std::array<int, 4> selection = { 0, 0, 0, 0 };
+    std::array<int, 2> selectionStart = { 0, 0 };
+
+    // Path tool: shortest path from pathStart to the moused over tile. The graph is only
+    // built once the tool is used, then kept up to date by setType/WriteRow. Bulk writes
+    // (over PATH_PATCH_TILES in a frame) drop it instead, it is rebuilt on the next query.
+    JunctionGraph pathGraph;
+    std::array<int, 2> pathStart = { -1, -1 };
+    std::array<int, 2> pathGoal = { -1, -1 };
+    bool pathDirty = false;
+    int pathPatchedTiles = 0;
+    JunctionGraph::PathResult path;
+    double pathQueryMs = 0;
+
+    // Copied tiles, and a one pixel per tile texture of them that follows the mouse while pasting
+    TileBlock clipboard;
+    bool isPasting = false;
+    sf::Texture clipboardPreview;
+    // Tiles per preview pixel (>1 when the clipboard is bigger than the max texture size)
+    int clipboardPreviewStep = 1;
+
+    // Positions of every non-blank tile by type (spawns, coins, ...), kept up to date by
+    // setType/WriteRow. Built on load, not built for paged or very big maps.
+    TileTypeIndex typeIndex;
+    // Build the index on load (the command line tools turn it off)
+    bool indexTiles = true;
+    // Old tiles of a WriteRow span, for the index
+    std::vector<std::uint8_t> indexScratch;
+    // Outcome of the last bulk operation, for the overlay
+    std::string bulkStatus;
+
+    // PLAY mode: a local GameSim moves Pac-Man and the ghosts, the entity store animates
+    // and draws them with the coins and effects. Sim entity k is store entity k.
+    bool playing = false;
+    GameSim playSim;
+    EntityStore entities;
+    std::uint16_t playerId = 0;
+    float playTickTime = 0;
+    // playSim.changes already turned into effects
+    std::size_t playChangesSeen = 0;
+    double entityUpdateMs = 0;
 
     void LoadTileTextures()
     {
         std::cout << "Loading tile textures...\n";
+        std::vector<sf::Image> images;
         for (int i = 0; i < tileTypeString.size(); i++)
         {
             // Lookfor: tiletypeString[i].png
             if (!tiletype_Textures[i].loadFromFile("tiles/" + tileTypeString[i] + ".png"))
                 throw std::runtime_error("Tile sprite" + tileTypeString[i] + ".png" + " not found");
+
+            sf::Image image = tiletype_Textures[i].copyToImage();
+            const std::uint8_t* px = image.getPixelsPtr();
+            std::size_t count = (std::size_t)image.getSize().x * image.getSize().y;
+            std::uint64_t sum[4] = { 0, 0, 0, 0 };
+            for (std::size_t p = 0; p < count * 4; p++) sum[p % 4] += px[p];
+            if (count > 0) tiletype_Colors[i] = sf::Color((std::uint8_t)(sum[0] / count), (std::uint8_t)(sum[1] / count), (std::uint8_t)(sum[2] / count), 255);
+            images.push_back(std::move(image));
         }
+        if (!tileAtlas.Build(images)) throw std::runtime_error("Could not build the tile atlas");
+        meshCache.SetTiles(tileAtlas, std::vector<sf::Color>(tiletype_Colors.begin(), tiletype_Colors.end()));
+        if (!entities.LoadAtlas()) throw std::runtime_error("Could not build the entity atlas");
     }
 
-    // Gets tile ref at row,col
+    // Gets tile ref at row,col (POINTERGRID only)
     Tile* get(int r, int c)
     {
 
         assert(r >= 0 && r < mapHeight && c >= 0 && c < mapWidth);
+        assert(storage == MAPSTORAGE::POINTERGRID);
         return grid[r * mapWidth + c];
     }
 
@@ -227,11 +390,469 @@ public:
         grid[(r * mapWidth) + c] = what;
     }
 
-    //enum class TILEID { BLANK = 0, WALL = 1, PLAYERSPAWN = 2, RED = 3, BLU = 4, ORANGE = 5, PINK = 6 };
-    void setSpecialLocVars(int index, sf::Vector2f value) override
+    // Gets tile type at row,col (any storage, pages in chunks as needed)
+    TILETYPE getType(int r, int c)
+    {
+        assert(r >= 0 && r < mapHeight && c >= 0 && c < mapWidth);
+        if (storage == MAPSTORAGE::PACKED) return static_cast<TILETYPE>(packed.get(r, c));
+        if (storage == MAPSTORAGE::PAGED) return static_cast<TILETYPE>(pager.getType(r, c));
+        return grid[r * mapWidth + c]->tileType;
+    }
+
+    // Sets tile type at row,col (any storage, pages in chunks as needed)
+    void setType(int r, int c, TILETYPE t)
+    {
+        assert(r >= 0 && r < mapHeight && c >= 0 && c < mapWidth);
+        if (typeIndex.isBuilt()) typeIndex.Set(r, c, (std::uint8_t)getType(r, c), (std::uint8_t)t);
+        if (storage == MAPSTORAGE::PACKED) packed.set(r, c, (std::uint8_t)t);
+        else if (storage == MAPSTORAGE::PAGED) pager.setType(r, c, (std::uint8_t)t);
+        else grid[r * mapWidth + c]->tileType = t;
+        chunkRevision[(r / CHUNK_SIZE) * revisionChunksX + c / CHUNK_SIZE]++;
+        if (pathGraph.isBuilt())
+        {
+            pathGraph.SetWalkable(r, c, t != TILETYPE::WALL);
+            pathDirty = true;
+        }
+    }
+
+    // Clears edit tracking (the tiles match what is on disk)
+    void ResetRevisions()
+    {
+        if (playing) StopPlay();
+        revisionChunksX = (mapWidth + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        chunkRevision.assign((std::size_t)revisionChunksX * ((mapHeight + CHUNK_SIZE - 1) / CHUNK_SIZE), 0);
+        journaledRevision = chunkRevision;
+        savedRevision = chunkRevision;
+        // New tiles, the path graph is rebuilt the next time it is needed
+        pathGraph.Clear();
+        pathStart = { -1, -1 };
+        // Rebuilt by IndexTiles once the new tiles are in
+        typeIndex.Clear();
+        // Every region mesh is rebuilt. Paged maps can be far bigger than RAM, so they get no minimap.
+        meshCache.Reset(mapHeight, mapWidth, CHUNK_SIZE, storage != MAPSTORAGE::PAGED);
+        minimapCursor = 0;
+    }
+
+    // Reads tile types [c0, c0 + n) of row r into out
+    void ReadRow(int r, int c0, int n, std::uint8_t* out)
+    {
+        if (storage == MAPSTORAGE::PACKED)
+        {
+            packed.readRow(r, c0, n, out);
+            return;
+        }
+        for (int j = 0; j < n; j++) out[j] = (std::uint8_t)getType(r, c0 + j);
+    }
+
+    // Writes tile types [c0, c0 + n) of row r from in
+    void WriteRow(int r, int c0, int n, const std::uint8_t* in)
+    {
+        if (typeIndex.isBuilt() && n > 0)
+        {
+            indexScratch.resize(n);
+            ReadRow(r, c0, n, indexScratch.data());
+            typeIndex.SetRow(r, c0, n, indexScratch.data(), in);
+        }
+        if (storage == MAPSTORAGE::PACKED) packed.writeRow(r, c0, n, in);
+        else if (storage == MAPSTORAGE::PAGED) pager.writeRow(r, c0, n, in);
+        else
+        {
+            Tile** row = &grid[r * mapWidth + c0];
+            for (int j = 0; j < n; j++) row[j]->tileType = static_cast<TILETYPE>(in[j]);
+        }
+        if (n <= 0) return;
+        for (int cc = c0 / CHUNK_SIZE; cc <= (c0 + n - 1) / CHUNK_SIZE; cc++) chunkRevision[(r / CHUNK_SIZE) * revisionChunksX + cc]++;
+        if (pathGraph.isBuilt())
+        {
+            pathPatchedTiles += n;
+            if (pathPatchedTiles > PATH_PATCH_TILES) pathGraph.Clear();
+            else for (int j = 0; j < n; j++) pathGraph.SetWalkable(r, c0 + j, in[j] != (std::uint8_t)TILETYPE::WALL);
+            pathDirty = true;
+        }
+    }
+
+    // setType on (r, c) and its mirror images for the current symmetry mode
+    void PaintTile(int r, int c, TILETYPE t)
+    {
+        std::array<std::array<int, 2>, 4> points;
+        int n = mirroredPoints(r, c, mapHeight, mapWidth, GLOBAL_input.symmetry, points);
+        for (int k = 0; k < n; k++) setType(points[k][0], points[k][1], t);
+    }
+
+    // PasteRegion at (r0, c0), plus flipped copies at the mirrored positions for the current symmetry mode
+    void PasteSymmetric(const TileBlock& block, int r0, int c0)
+    {
+        SYMMETRY s = GLOBAL_input.symmetry;
+        int mirroredR = mapHeight - r0 - block.rows, mirroredC = mapWidth - c0 - block.cols;
+        PasteRegion(block, r0, c0);
+        if (s == SYMMETRY::HORIZONTAL || s == SYMMETRY::BOTH) PasteRegion(TransformBlock(block, MAPTRANSFORM::FLIP_H), r0, mirroredC);
+        if (s == SYMMETRY::VERTICAL || s == SYMMETRY::BOTH) PasteRegion(TransformBlock(block, MAPTRANSFORM::FLIP_V), mirroredR, c0);
+        if (s == SYMMETRY::BOTH) PasteRegion(TransformBlock(block, MAPTRANSFORM::ROTATE_180), mirroredR, mirroredC);
+    }
+
+    // Applies t to the clipboard while pasting, else to the selection (kept anchored at its
+    // top left corner, clipped to the map), else to the whole map
+    void ApplyTransform(MAPTRANSFORM t)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (isPasting)
+        {
+            clipboard = TransformBlock(clipboard, t);
+            BuildClipboardPreview();
+            return;
+        }
+        if (hasSelection)
+        {
+            int rows = selection[2] - selection[0] + 1;
+            int cols = selection[3] - selection[1] + 1;
+            TileBlock result = TransformBlock(CopyRegion(selection[0], selection[1], rows, cols), t);
+            // A rotated non-square selection does not cover its old footprint, what it leaves is cleared
+            if (result.rows != rows) FillRegion(selection[0], selection[1], rows, cols, TILETYPE::BLANK);
+            PasteRegion(result, selection[0], selection[1]);
+            selection[2] = std::min(mapHeight - 1, selection[0] + result.rows - 1);
+            selection[3] = std::min(mapWidth - 1, selection[1] + result.cols - 1);
+        }
+        else
+        {
+            // Paged maps can be far bigger than RAM, they are only transformed a selection at a time
+            if (storage == MAPSTORAGE::PAGED)
+            {
+                std::cout << "Whole-map transforms are not supported for paged maps, select a region first\n";
+                return;
+            }
+            TileBlock result = TransformBlock(CopyRegion(0, 0, mapHeight, mapWidth), t);
+            if (result.rows != mapHeight || result.cols != mapWidth)
+            {
+                // New dimensions: fresh grid, and a journal with the new chunk layout
+                // (the rotated tiles below are its first edits)
+                bool wasAutosaving = journal.isRunning();
+                Clear();
+                CreateBlank(result.rows, result.cols, storage);
+                if (wasAutosaving) StartAutosave(false);
+            }
+            PasteRegion(result, 0, 0);
+        }
+        std::cout << mapTransformString[(int)t] << " in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms\n";
+    }
+
+    // Replaces every tile with a generated maze (any storage), band by band
+    void GenerateMaze(std::uint64_t seed)
+    {
+        MazeSettings settings;
+        settings.rows = mapHeight;
+        settings.cols = mapWidth;
+        settings.seed = seed;
+        // Paged maps fault chunks in while writing, keep them on one thread
+        if (storage == MAPSTORAGE::PAGED) settings.threads = 1;
+        MazeGenerator(settings).Generate([this](int r0, const TileBlock& band) { PasteRegion(band, r0, 0); });
+    }
+
+    // Builds the pathfinding graph from the current tiles (everything but walls is walkable)
+    void BuildPathGraph()
+    {
+        std::vector<std::uint8_t> walkable((std::size_t)mapHeight * mapWidth);
+        for (int i = 0; i < mapHeight; i++)
+        {
+            std::uint8_t* row = &walkable[(std::size_t)i * mapWidth];
+            ReadRow(i, 0, mapWidth, row);
+            for (int j = 0; j < mapWidth; j++) row[j] = row[j] != (std::uint8_t)TILETYPE::WALL;
+        }
+        pathGraph.Build(mapHeight, mapWidth, std::move(walkable));
+        std::cout << "Path graph: " << pathGraph.liveNodes << " junctions, " << pathGraph.liveCorridors << " corridors\n";
+    }
+
+    // Path tool requested through GLOBAL_input, and the path to the moused over tile
+    void UpdatePathTool(std::array<int, 2> mouseOver)
+    {
+        pathPatchedTiles = 0;
+        if (GLOBAL_input.pathRequested)
+        {
+            GLOBAL_input.pathRequested = false;
+            if (pathStart[0] != -1) pathStart = { -1, -1 };
+            // Paged maps can be far bigger than RAM, they get no graph
+            else if (storage != MAPSTORAGE::PAGED && mouseOver[0] != -1 && mouseOver[1] != -1)
+            {
+                if (!pathGraph.isBuilt()) BuildPathGraph();
+                pathStart = mouseOver;
+                pathDirty = true;
+            }
+        }
+        if (pathStart[0] == -1 || mouseOver[0] == -1 || mouseOver[1] == -1) return;
+        if (!pathDirty && mouseOver == pathGoal) return;
+
+        pathGoal = mouseOver;
+        pathDirty = false;
+        // Dropped by a bulk write
+        if (!pathGraph.isBuilt()) BuildPathGraph();
+        auto start = std::chrono::steady_clock::now();
+        path = pathGraph.FindPath(pathStart[0] * mapWidth + pathStart[1], pathGoal[0] * mapWidth + pathGoal[1], true);
+        pathQueryMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Swaps in finished region meshes, then queues jobs for visible regions that changed
+    // and, a slice per frame, for stale minimap regions anywhere on the map
+    void UpdateMeshes(sf::RenderWindow& window)
+    {
+        if (!meshCache.hasTiles()) return;
+        meshCache.Collect();
+
+        std::array<int, 4> visible = getVisibleTileRange(window);
+        if (visible[2] > visible[0] && visible[3] > visible[1])
+        {
+            for (int ry = visible[0] / CHUNK_SIZE; ry <= (visible[2] - 1) / CHUNK_SIZE; ry++)
+            {
+                for (int rx = visible[1] / CHUNK_SIZE; rx <= (visible[3] - 1) / CHUNK_SIZE; rx++)
+                {
+                    int id = ry * revisionChunksX + rx;
+                    if (!meshCache.canSubmit()) return;
+                    if (meshCache.needsMesh(id, chunkRevision[id])) SubmitRegion(id, true);
+                }
+            }
+        }
+
+        if (!meshCache.minimapEnabled) return;
+        // Bounded scan, so huge maps do not walk every region each frame
+        for (int k = 0; k < 256 && meshCache.canSubmit(); k++)
+        {
+            int id = minimapCursor;
+            minimapCursor = (minimapCursor + 1) % meshCache.regionCount();
+            if (meshCache.needsMinimap(id, chunkRevision[id])) SubmitRegion(id, false);
+        }
+    }
+
+    // Hands a copy of region id's tiles to the mesh workers
+    void SubmitRegion(int id, bool mesh)
+    {
+        int r0 = (id / revisionChunksX) * CHUNK_SIZE, c0 = (id % revisionChunksX) * CHUNK_SIZE;
+        TileBlock tiles = CopyRegion(r0, c0, std::min(CHUNK_SIZE, mapHeight - r0), std::min(CHUNK_SIZE, mapWidth - c0));
+        meshCache.Submit(id, chunkRevision[id], mesh, std::move(tiles));
+    }
+
+    std::string getMeshStats()
+    {
+        std::ostringstream ss;
+        ss << "meshes: " << meshCache.getMeshBytes() / (1024 * 1024) << " MB | jobs in flight " << meshCache.getPendingJobs();
+        return ss.str();
+    }
+
+    std::string getPathStats()
+    {
+        std::ostringstream ss;
+        ss.precision(3);
+        ss << std::fixed << "path (F): ";
+        if (path.distance < 0) ss << "unreachable";
+        else ss << path.distance << " steps";
+        ss << " in " << pathQueryMs << " ms | " << pathGraph.liveNodes << " junctions";
+        return ss.str();
+    }
+
+    // Builds the tile type index from the current tiles (not for paged maps or maps too big to index)
+    void IndexTiles()
+    {
+        typeIndex.Clear();
+        if (!indexTiles || storage == MAPSTORAGE::PAGED || !TileTypeIndex::fits(mapHeight, mapWidth)) return;
+        typeIndex.Build(mapHeight, mapWidth, TILETYPE_LEN, [this](int r, std::uint8_t* out) { ReadRow(r, 0, mapWidth, out); });
+    }
+
+    // Number of tiles of type t (a full scan when the map is not indexed)
+    std::uint64_t CountTiles(TILETYPE t)
+    {
+        if (typeIndex.isBuilt()) return typeIndex.count((std::uint8_t)t);
+        std::uint64_t count = 0;
+        std::vector<std::uint8_t> row(mapWidth);
+        for (int i = 0; i < mapHeight; i++)
+        {
+            ReadRow(i, 0, mapWidth, row.data());
+            count += std::count(row.begin(), row.end(), (std::uint8_t)t);
+        }
+        return count;
+    }
+
+    // {row, col} of every tile of type t, in no particular order (a full scan when the map is not indexed)
+    std::vector<std::array<int, 2>> FindTiles(TILETYPE t)
+    {
+        std::vector<std::array<int, 2>> found;
+        if (typeIndex.isBuilt() && t != TILETYPE::BLANK)
+        {
+            const std::vector<std::uint32_t>& positions = typeIndex.get((std::uint8_t)t);
+            found.reserve(positions.size());
+            for (std::uint32_t pos : positions) found.push_back(typeIndex.toRowCol(pos));
+            return found;
+        }
+        std::vector<std::uint8_t> row(mapWidth);
+        for (int i = 0; i < mapHeight; i++)
+        {
+            ReadRow(i, 0, mapWidth, row.data());
+            for (int j = 0; j < mapWidth; j++)
+            {
+                if (row[j] == (std::uint8_t)t) found.push_back({ i, j });
+            }
+        }
+        return found;
+    }
+
+    // What keeps the map from being playable, empty if nothing
+    std::vector<std::string> ValidateMap()
+    {
+        std::vector<std::string> problems;
+        std::uint64_t players = CountTiles(TILETYPE::PLAYERSPAWN);
+        if (players != 1) problems.push_back("needs exactly one player spawn, has " + std::to_string(players));
+        if (CountTiles(TILETYPE::GHOSTSPAWN) == 0) problems.push_back("has no ghost spawn");
+        if (CountTiles(TILETYPE::COIN) == 0) problems.push_back("has no coins");
+        return problems;
+    }
+
+    std::string getTileCountStats()
+    {
+        std::ostringstream ss;
+        for (int t = 1; t < TILETYPE_LEN; t++) ss << tileTypeString[t] << " " << typeIndex.count((std::uint8_t)t) << " | ";
+        std::vector<std::string> problems = ValidateMap();
+        if (problems.empty()) ss << "playable";
+        else ss << "map " << problems[0];
+        return ss.str();
+    }
+
+    // Runs a bulk operation over the selection, or the whole map without one. Changed rows
+    // go through WriteRow, so the index, revisions and autosave follow.
+    BulkResult RunBulk(const BulkOp& op)
+    {
+        BulkArea area = { 0, 0, mapHeight, mapWidth };
+        if (hasSelection) area = { selection[0], selection[1], selection[2] - selection[0] + 1, selection[3] - selection[1] + 1 };
+        // Whole map counts are already in the index
+        if (op.kind == BULKOP::HISTOGRAM && !hasSelection && typeIndex.isBuilt())
+        {
+            BulkResult result;
+            for (int t = 0; t < TILETYPE_LEN; t++) result.histogram.push_back(typeIndex.count((std::uint8_t)t));
+            return result;
+        }
+        // The pager is not thread safe
+        int threads = storage == MAPSTORAGE::PAGED ? 1 : 0;
+        return RunBulkOp(op, area, mapHeight, mapWidth, TILETYPE_LEN,
+            [this](int r, std::uint8_t* out) { ReadRow(r, 0, mapWidth, out); },
+            [this](int r, int c0, int n, const std::uint8_t* in) { WriteRow(r, c0, n, in); }, false, threads);
+    }
+
+    // Bulk commands requested through GLOBAL_input, mouseOver is the tile under the mouse
+    void HandleBulkCommands(std::array<int, 2> mouseOver)
+    {
+        std::ostringstream ss;
+        ss.precision(1);
+        ss << std::fixed;
+        if (GLOBAL_input.histogramRequested)
+        {
+            GLOBAL_input.histogramRequested = false;
+            BulkResult result = RunBulk(BulkOp());
+            ss << (hasSelection ? "selection: " : "map: ");
+            for (int t = 0; t < TILETYPE_LEN; t++) ss << tileTypeString[t] << " " << result.histogram[t] << " | ";
+            ss << result.ms << " ms";
+            bulkStatus = ss.str();
+            std::cout << bulkStatus << "\n";
+        }
+        if (GLOBAL_input.replaceRequested)
+        {
+            GLOBAL_input.replaceRequested = false;
+            if (mouseOver[0] == -1 || mouseOver[1] == -1) return;
+            BulkOp op;
+            op.kind = BULKOP::SET;
+            op.from = (int)getType(mouseOver[0], mouseOver[1]);
+            op.to = (std::uint8_t)GLOBAL_input.tileType;
+            if (GLOBAL_input.replaceOnBorder) op.mask.kind = BULKMASK::BORDER;
+            BulkResult result = RunBulk(op);
+            ss << "replaced " << result.changed << " " << tileTypeString[op.from] << " with " << tileTypeString[op.to]
+                << (op.mask.kind == BULKMASK::BORDER ? " on the border" : "") << (hasSelection ? " in the selection" : "")
+                << " | " << result.ms << " ms";
+            bulkStatus = ss.str();
+            std::cout << bulkStatus << "\n";
+        }
+    }
+
+    // Copies a rectangle of the map into a TileBlock, one row span at a time
+    TileBlock CopyRegion(int r0, int c0, int rows, int cols)
+    {
+        TileBlock block;
+        block.Create(rows, cols);
+        for (int i = 0; i < rows; i++) ReadRow(r0 + i, c0, cols, block.row(i));
+        return block;
+    }
+
+    // Writes block with its top left at (r0, c0), clipped to the map
+    void PasteRegion(const TileBlock& block, int r0, int c0)
+    {
+        int srcC = std::max(0, -c0);
+        int dstC = std::max(0, c0);
+        int n = std::min(block.cols - srcC, mapWidth - dstC);
+        if (n <= 0) return;
+        for (int i = std::max(0, -r0); i < block.rows && r0 + i < mapHeight; i++)
+        {
+            WriteRow(r0 + i, dstC, n, block.row(i) + srcC);
+        }
+    }
+
+    // Sets every tile in the rectangle to t
+    void FillRegion(int r0, int c0, int rows, int cols, TILETYPE t)
+    {
+        std::vector<std::uint8_t> row(cols, (std::uint8_t)t);
+        for (int i = 0; i < rows; i++) WriteRow(r0 + i, c0, cols, row.data());
+    }
+
+    // Rebuilds the mouse-following paste preview from the clipboard
+    void BuildClipboardPreview()
+    {
+        unsigned maxSize = sf::Texture::getMaximumSize();
+        int biggest = std::max(clipboard.rows, clipboard.cols);
+        clipboardPreviewStep = (int)((biggest + maxSize - 1) / maxSize);
+        if (clipboardPreviewStep < 1) clipboardPreviewStep = 1;
+
+        unsigned w = (unsigned)((clipboard.cols + clipboardPreviewStep - 1) / clipboardPreviewStep);
+        unsigned h = (unsigned)((clipboard.rows + clipboardPreviewStep - 1) / clipboardPreviewStep);
+        std::vector<std::uint8_t> pixels((std::size_t)w * h * 4);
+        for (unsigned y = 0; y < h; y++)
+        {
+            const std::uint8_t* src = clipboard.row(y * clipboardPreviewStep);
+            std::uint8_t* dst = &pixels[(std::size_t)y * w * 4];
+            for (unsigned x = 0; x < w; x++)
+            {
+                sf::Color c = tiletype_Colors[src[x * clipboardPreviewStep]];
+                dst[x * 4 + 0] = c.r;
+                dst[x * 4 + 1] = c.g;
+                dst[x * 4 + 2] = c.b;
+                dst[x * 4 + 3] = c.a;
+            }
+        }
+        if (!clipboardPreview.loadFromImage(sf::Image({ w, h }, pixels.data())))
+            std::cout << "Error: could not create clipboard preview\n";
+    }
+
+    // Copy/cut/paste/cancel requested through GLOBAL_input
+    void HandleClipboardCommands()
+    {
+        if ((GLOBAL_input.copyRequested || GLOBAL_input.cutRequested) && hasSelection)
+        {
+            int rows = selection[2] - selection[0] + 1;
+            int cols = selection[3] - selection[1] + 1;
+            clipboard = CopyRegion(selection[0], selection[1], rows, cols);
+            if (GLOBAL_input.cutRequested) FillRegion(selection[0], selection[1], rows, cols, TILETYPE::BLANK);
+            BuildClipboardPreview();
+            std::cout << "Copied " << rows << "x" << cols << " tiles\n";
+        }
+        if (GLOBAL_input.pasteRequested && !clipboard.empty()) isPasting = true;
+        if (GLOBAL_input.cancelRequested)
+        {
+            isPasting = false;
+            hasSelection = false;
+        }
+        GLOBAL_input.copyRequested = false;
+        GLOBAL_input.cutRequested = false;
+        GLOBAL_input.pasteRequested = false;
+        GLOBAL_input.cancelRequested = false;
+    }
+
+    // Approximate bytes used by the tiles (resident chunks only for paged maps)
+    std::size_t getMemoryBytes()
     {
-        // todo error checking if it already was set
-        *specialVars[index] = value;
+        if (storage == MAPSTORAGE::PACKED) return packed.memoryBytes();
+        if (storage == MAPSTORAGE::PAGED) return pager.residentBytes();
+        return grid.capacity() * sizeof(Tile*) + grid.size() * sizeof(Tile);
     }
 
     // Gets number of cols
@@ -242,18 +863,42 @@ public:
     // Creates grid full of NULL ptrs.
     void CreateEmpty(int _rows, int _cols)
     {
+        storage = MAPSTORAGE::POINTERGRID;
+        lastPlaced = { -1, -1 };
         mapHeight = _rows;
         mapWidth = _cols;
         grid.assign(mapHeight * mapWidth, nullptr);
+        ResetRevisions();
+        this->isInitialized = true;
+    }
+
+    // Creates an all-blank packed grid
+    void CreatePacked(int _rows, int _cols)
+    {
+        storage = MAPSTORAGE::PACKED;
+        lastPlaced = { -1, -1 };
+        mapHeight = _rows;
+        mapWidth = _cols;
+        packed.Create(mapHeight, mapWidth);
+        ResetRevisions();
         this->isInitialized = true;
     }
 
     // Creates grid full of objects (not null)
-    void CreateBlank(int _rows, int _cols)
+    void CreateBlank(int _rows, int _cols, MAPSTORAGE layout = MAPSTORAGE::POINTERGRID)
     {
+        if (layout == MAPSTORAGE::PACKED)
+        {
+            CreatePacked(_rows, _cols);
+            IndexTiles();
+            return;
+        }
+        storage = MAPSTORAGE::POINTERGRID;
+        lastPlaced = { -1, -1 };
         mapHeight = _rows;
         mapWidth = _cols;
         grid.assign(mapHeight * mapWidth, nullptr);
+        ResetRevisions();
         for (int i = 0; i < mapHeight; i++)
         {
             for (int j = 0; j < mapWidth; j++)
@@ -263,21 +908,131 @@ public:
                 //grid[(i * mapWidth) + j] = tile;
             }
         }
+        IndexTiles();
+    }
+
+    // Creates a blank paged map backed by a new .pmap file at path
+    void CreatePaged(std::string path, int _rows, int _cols)
+    {
+        Clear();
+        if (!pager.Create(path, _rows, _cols)) throw std::runtime_error("Error: could not create paged map '" + path + "'");
+        storage = MAPSTORAGE::PAGED;
+        lastPlaced = { -1, -1 };
+        mapHeight = _rows;
+        mapWidth = _cols;
+        filePath = path;
+        ResetRevisions();
+        this->isInitialized = true;
+    }
+
+    // Opens an existing .pmap file, no tiles are read until they are needed
+    void LoadPaged(std::string path)
+    {
+        std::cout << "Opening paged map '" << path << "'\n";
+        // Opened on the side so a file that can't be opened (read-only, not a .pmap) leaves
+        // the current map as it is. Flushed first in case it is the same file.
+        pager.Flush();
+        MapPager opened;
+        opened.memoryBudget = pager.memoryBudget;
+        opened.prefetchDistance = pager.prefetchDistance;
+        if (!opened.Open(path))
+        {
+            std::cerr << "Failed to open file.\n";
+            return;
+        }
+        Clear();
+        pager = std::move(opened);
+        storage = MAPSTORAGE::PAGED;
+        lastPlaced = { -1, -1 };
+        mapHeight = pager.rows;
+        mapWidth = pager.cols;
+        filePath = path;
+        ResetRevisions();
+        this->isInitialized = true;
+        std::cout << "size: (" << mapHeight << "x" << mapWidth << "), " << pager.chunksX * pager.chunksY << " chunks\n";
+    }
+
+    // Writes this map to a new .pmap file
+    void SavePaged(std::string path)
+    {
+        if (storage == MAPSTORAGE::PAGED && path == pager.getPath())
+        {
+            pager.Flush();
+            return;
+        }
+        MapPager out;
+        out.memoryBudget = pager.memoryBudget;
+        if (!out.Create(path, mapHeight, mapWidth))
+        {
+            std::cerr << "Failed to open file for writing.\n";
+            return;
+        }
+        // Chunk rows at a time so both caches stay warm
+        for (int r0 = 0; r0 < mapHeight; r0 += CHUNK_SIZE)
+        {
+            for (int j = 0; j < mapWidth; j++)
+            {
+                for (int i = r0; i < std::min(r0 + CHUNK_SIZE, mapHeight); i++)
+                {
+                    out.setType(i, j, (std::uint8_t)getType(i, j));
+                }
+            }
+        }
+        out.Close();
     }
 
-    // Frees all ptrs
+    // Frees all ptrs (and closes the paged file, writing back dirty chunks)
     void Clear()
     {
         for (Tile* ptr : grid)
         {
             delete ptr;
         }
+        grid.clear();
+        packed.Clear();
+        pager.Close();
+    }
+
+    // Gets the visible tile rect {row0, col0, row1, col1} (row1/col1 exclusive), clamped to the map
+    std::array<int, 4> getVisibleTileRange(sf::RenderWindow& window)
+    {
+        float scale = CAMERA_ZOOM;
+        sf::Vector2f cameraPos(CAMERA_X, CAMERA_Y);
+        sf::Vector2f windowSize((float)window.getSize().x, (float)window.getSize().y);
+
+        // Same inverse transform as getTileMousedOver, for both window corners
+        sf::Vector2f topLeft = (cameraPos - screenPos) / scale;
+        sf::Vector2f bottomRight = (windowSize - screenPos + cameraPos) / scale;
+
+        int r0 = std::max(0, (int)std::floor(topLeft.y / TILE_SIZE));
+        int c0 = std::max(0, (int)std::floor(topLeft.x / TILE_SIZE));
+        int r1 = std::min(mapHeight, (int)std::floor(bottomRight.y / TILE_SIZE) + 1);
+        int c1 = std::min(mapWidth, (int)std::floor(bottomRight.x / TILE_SIZE) + 1);
+        return { r0, c0, std::max(r0, r1), std::max(c0, c1) };
+    }
+
+    std::string getPageCacheStats()
+    {
+        std::ostringstream ss;
+        ss.precision(1);
+        ss << std::fixed << "page cache: hit " << pager.stats.hitRate() * 100 << "% | "
+            << pager.residentChunks() << " chunks (" << pager.residentBytes() / (1024 * 1024) << "/"
+            << pager.memoryBudget / (1024 * 1024) << " MB) | prefetched " << pager.stats.prefetched
+            << " | written " << pager.stats.writeBacks;
+        return ss.str();
     }
 
     // Input will be a .csv. Each tile = tileid
     // First row should be [ROWS, COLS]
-    void LoadFromFile(std::string path)
+    // layout picks the in-memory storage (.pmap files are always paged)
+    void LoadFromFile(std::string path, MAPSTORAGE layout = MAPSTORAGE::POINTERGRID)
     {
+        ALLOC_SCOPE("LoadFromFile");
+        if (hasExtension(path, ".pmap"))
+        {
+            LoadPaged(path);
+            return;
+        }
         std::cout << "Loading map '" << path << "'\n";
         
         //std::cout << std::filesystem::absolute(path) << std::endl;
@@ -330,12 +1085,16 @@ public:
                 if (_row != -1)
                 {
 
-                    if (asInt < 0 || asInt > TILETYPE_LEN) throw std::runtime_error("File error: csv field is not valid tileID");
+                    if (asInt < 0 || asInt >= TILETYPE_LEN) throw std::runtime_error("File error: csv field is not valid tileID");
                     // otherwise ok
 
                     // Create tile
-                    Tile* newTile = new Tile(this, _row, _col, static_cast<TILETYPE>(asInt));
-                    set(_row, _col, newTile);
+                    if (storage == MAPSTORAGE::POINTERGRID)
+                    {
+                        Tile* newTile = new Tile(this, _row, _col, static_cast<TILETYPE>(asInt));
+                        set(_row, _col, newTile);
+                    }
+                    else setType(_row, _col, static_cast<TILETYPE>(asInt));
                 }
                 else // For first row, cols are [mapHeight, mapWidth] /!IMPORTANT
                 {
@@ -350,7 +1109,8 @@ public:
             {
                 // Ensure no memory leaks
                 Clear();
-                CreateEmpty(mapHeight, mapWidth);
+                if (layout == MAPSTORAGE::PACKED) CreatePacked(mapHeight, mapWidth);
+                else CreateEmpty(mapHeight, mapWidth);
                 std::cout << "\nsize: (" << mapHeight << "x" << mapWidth << ")\n";
             }
             //std::cout << "\n";
@@ -361,7 +1121,7 @@ public:
         if (maxRowReached == -1)
         {
             std::cout << "Header only map detected, filling with EMPTY\n";
-            CreateBlank(mapHeight, mapWidth);
+            CreateBlank(mapHeight, mapWidth, layout);
         }
         else
         {
@@ -370,6 +1130,9 @@ public:
         }
 
 
+        filePath = path;
+        ResetRevisions();
+        IndexTiles();
         std::cout << "Map loaded.\n";
     }
     
@@ -377,43 +1140,144 @@ public:
     void SaveToFile(std::string path)
     {
         std::cout << "Saving to file '" << path << "'...\n";
+        if (hasExtension(path, ".pmap"))
+        {
+            SavePaged(path);
+            std::cout << "Done.\n";
+            OnSaved(path);
+            return;
+        }
 
-        std::ofstream file(path); // creates file if it doesn't exist
-        if (!file) {
-            std::cerr << "Failed to open file for writing.\n";
+        // Formatted on all cores into a temp file, which then replaces the old one
+        auto start = std::chrono::steady_clock::now();
+        MapRowReader readRow = [this](int r, std::uint8_t* out) { ReadRow(r, 0, mapWidth, out); };
+        // Paged maps fault chunks in while reading, so they are read from one thread
+        CsvWriteResult result = WriteMapCsv(path, mapHeight, mapWidth, readRow, storage == MAPSTORAGE::PAGED ? 1 : 0);
+        if (!result.ok) {
+            std::cerr << "Failed to save: " << result.error << "\n";
             return;
         }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Done, " << result.bytes / (1024 * 1024) << " MB in " << ms << " ms.\n";
+        // Saved anyway, maps are often saved half done
+        if (typeIndex.isBuilt())
+        {
+            for (const std::string& problem : ValidateMap()) std::cout << "Warning: map " << problem << "\n";
+        }
+        OnSaved(path);
+    }
 
-        
-        // Write header
-        file << mapHeight << "," << mapWidth << "\n";
-        // Write contents
-        for (int i = 0; i < mapHeight; i++)
+    // Journal path for the current map
+    std::string getJournalPath()
+    {
+        return (filePath.empty() ? std::string("untitled") : filePath) + ".journal";
+    }
+
+    // Starts autosaving the current map. With recover, edits left in its journal
+    // (unsaved work or a crash) are offered for replay once the worker has read them.
+    void StartAutosave(bool recover)
+    {
+        journal.Stop();
+        // Paged maps write their own chunks back to the .pmap
+        if (storage == MAPSTORAGE::PAGED || !isInitialized) return;
+
+        journaledRevision = chunkRevision;
+        savedRevision = chunkRevision;
+        autosaveTimer = 0;
+        journal.Start(getJournalPath(), filePath, mapHeight, mapWidth, CHUNK_SIZE, recover);
+    }
+
+    // Asks whether to put the recovered chunks back on top of the loaded tiles.
+    // Declined, the journal starts over from the map file.
+    void RecoverJournal(const std::vector<JournalRecord>& records)
+    {
+        std::string name = filePath.empty() ? std::string("the untitled map") : "'" + filePath + "'";
+        std::string message = "There are unsaved edits to " + std::to_string(records.size()) + " regions of " + name
+            + " from an earlier session.\nRestore them?";
+        if (!AskYesNo("Recover unsaved edits", message))
         {
-            for (int j = 0; j < mapWidth; j++)
-            {
-                // Write tile type data
-                file << (int)get(i, j)->tileType;
-                // Add comma seperator (unless last in row)
-                if (j != mapWidth - 1) file << ",";
-            }
-            file << "\n";
+            journal.Reset();
+            // Edits made since the load still have to go into the emptied journal
+            journaledRevision = savedRevision;
+            return;
         }
-        // done
 
-        file.close();
-        std::cout << "Done.\n";
+        for (const JournalRecord& rec : records)
+        {
+            int r0 = rec.chunkRow * CHUNK_SIZE;
+            int c0 = rec.chunkCol * CHUNK_SIZE;
+            if (r0 < 0 || r0 >= mapHeight || c0 < 0 || c0 >= mapWidth) continue;
+            int n = std::min(CHUNK_SIZE, mapWidth - c0);
+            for (int i = 0; i < CHUNK_SIZE && r0 + i < mapHeight; i++) WriteRow(r0 + i, c0, n, &rec.tiles[i * CHUNK_SIZE]);
+            // Already in the journal
+            std::size_t id = (std::size_t)rec.chunkRow * revisionChunksX + rec.chunkCol;
+            journaledRevision[id] = chunkRevision[id];
+        }
+        std::cout << "Autosave: recovered " << records.size() << " chunks from '" << journal.getPath() << "'\n";
+    }
+
+    // Edits since the last load or save
+    bool hasUnsavedEdits() const
+    {
+        return chunkRevision != savedRevision;
+    }
+
+    // Hands the chunks changed since the last checkpoint to the journal thread.
+    // Only copies tiles, the worker does the disk writes.
+    void AutosaveTick(float dt, bool force = false)
+    {
+        if (!journal.isRunning()) return;
+        std::vector<JournalRecord> recovered;
+        if (journal.TakeRecovered(recovered)) RecoverJournal(recovered);
+        autosaveTimer += dt;
+        if (!force && autosaveTimer < AUTOSAVE_INTERVAL) return;
+        autosaveTimer = 0;
+
+        std::vector<JournalRecord> records;
+        for (std::size_t id = 0; id < chunkRevision.size(); id++)
+        {
+            if (chunkRevision[id] == journaledRevision[id]) continue;
+            journaledRevision[id] = chunkRevision[id];
+
+            JournalRecord rec;
+            rec.chunkRow = (std::int32_t)(id / revisionChunksX);
+            rec.chunkCol = (std::int32_t)(id % revisionChunksX);
+            rec.tiles.assign(CHUNK_SIZE * CHUNK_SIZE, 0);
+            int r0 = rec.chunkRow * CHUNK_SIZE;
+            int c0 = rec.chunkCol * CHUNK_SIZE;
+            int n = std::min(CHUNK_SIZE, mapWidth - c0);
+            for (int i = 0; i < CHUNK_SIZE && r0 + i < mapHeight; i++) ReadRow(r0 + i, c0, n, &rec.tiles[i * CHUNK_SIZE]);
+            records.push_back(std::move(rec));
+        }
+        journal.Submit(std::move(records));
+    }
+
+    // After a successful save the journal is no longer needed
+    void OnSaved(std::string path)
+    {
+        bool wasAutosaving = journal.isRunning();
+        savedRevision = chunkRevision;
+        if (path == filePath)
+        {
+            journal.Reset();
+            journaledRevision = chunkRevision;
+            return;
+        }
+        // Saved under a new name: the worker deletes the old journal, follow the new file
+        journal.Stop(true);
+        filePath = path;
+        if (wasAutosaving) StartAutosave(false);
     }
 
 
     // Gets {row, col} that is being moused over. returns {-1,-1} if not moused over anything
-    std::array<int, 2> getTileMousedOver(sf::RenderWindow &window)
+    std::array<int, 2> getTileMousedOver()
     {
         float scale = CAMERA_ZOOM;
         sf::Vector2f cameraPos(CAMERA_X, CAMERA_Y);
 
         // Mouse position in window space
-        sf::Vector2i pixelPos = sf::Mouse::getPosition(window);
+        sf::Vector2i pixelPos = GLOBAL_input.mousePos;
         sf::Vector2f screen(static_cast<float>(pixelPos.x),
             static_cast<float>(pixelPos.y));
 
@@ -431,9 +1295,9 @@ public:
     }
 
     // Returns true if mouse is moused over row, col
-    bool isMouseOver(int row, int col, sf::RenderWindow& window)
+    bool isMouseOver(int row, int col)
     {
-        std::array<int, 2> mousedOver = getTileMousedOver(window);
+        std::array<int, 2> mousedOver = getTileMousedOver();
         return mousedOver[0] == row && mousedOver[1] == col;
     }
 
@@ -474,65 +1338,261 @@ public:
         return _result;
     }
 
+    // Centre of tile (r, c) in map pixels
+    static sf::Vector2f tileCenter(int r, int c) { return sf::Vector2f((c + 0.5f) * TILE_SIZE, (r + 0.5f) * TILE_SIZE); }
+
+    // Starts PLAY mode on a copy of the tiles: one Pac-Man, the ghosts and a coin entity per
+    // coin tile. Spawn and coin tiles are drawn as blank while playing.
+    void StartPlay()
+    {
+        if (!isInitialized || storage == MAPSTORAGE::PAGED || (long long)mapHeight * mapWidth > MAX_INMEMORY_TILES)
+        {
+            std::cout << "PLAY mode needs an in-memory map\n";
+            return;
+        }
+        playSim = GameSim((std::uint64_t)std::chrono::system_clock::now().time_since_epoch().count());
+        playSim.Load(CopyRegion(0, 0, mapHeight, mapWidth));
+        playerId = playSim.AddPlayer();
+        playTickTime = 0;
+        playChangesSeen = 0;
+
+        static const sf::Color ghostColors[4] = { sf::Color(255, 40, 40), sf::Color(255, 170, 220), sf::Color(60, 230, 255), sf::Color(255, 170, 60) };
+        std::vector<std::array<int, 2>> coins = FindTiles(TILETYPE::COIN);
+        entities.Clear();
+        entities.Reserve(playSim.state.entities.size() + coins.size());
+        for (const SimEntity& e : playSim.state.entities)
+        {
+            sf::Vector2f p = tileCenter(e.row, e.col);
+            if (e.kind == SIMENTITY::PACMAN) entities.Add(ENTITYKIND::PLAYER, p.x, p.y, (float)TILE_SIZE);
+            else entities.Add(ENTITYKIND::GHOST, p.x, p.y, (float)TILE_SIZE, ghostColors[e.id % 4]);
+        }
+        for (const std::array<int, 2>& c : coins)
+        {
+            sf::Vector2f p = tileCenter(c[0], c[1]);
+            entities.Add(ENTITYKIND::COIN, p.x, p.y, TILE_SIZE * 0.75f);
+        }
+
+        std::vector<std::uint8_t> drawnAs(TILETYPE_LEN);
+        for (int t = 0; t < TILETYPE_LEN; t++) drawnAs[t] = (std::uint8_t)t;
+        drawnAs[(int)TILETYPE::COIN] = drawnAs[(int)TILETYPE::PLAYERSPAWN] = drawnAs[(int)TILETYPE::GHOSTSPAWN] = (std::uint8_t)TILETYPE::BLANK;
+        meshCache.SetDrawnAs(drawnAs);
+        hasSelection = false;
+        isPasting = false;
+        playing = true;
+        game_MODE = MODE::PLAY;
+        std::cout << "PLAY: " << entities.count() << " entities\n";
+    }
+
+    void StopPlay()
+    {
+        playing = false;
+        game_MODE = MODE::DEBUG;
+        entities.Clear();
+        std::vector<std::uint8_t> drawnAs(TILETYPE_LEN);
+        for (int t = 0; t < TILETYPE_LEN; t++) drawnAs[t] = (std::uint8_t)t;
+        meshCache.SetDrawnAs(drawnAs);
+    }
+
+    // One sim tick: movers head for their new tile over the next tick, eaten coins burst
+    void StepPlay()
+    {
+        playSim.SetInput(playerId, GLOBAL_input.playDirection);
+        playSim.Step();
+        const float tickRate = PLAY_TICKS_PER_SECOND;
+        for (std::size_t k = 0; k < playSim.state.entities.size(); k++)
+        {
+            const SimEntity& e = playSim.state.entities[k];
+            sf::Vector2f target = tileCenter(e.row, e.col);
+            float dx = target.x - entities.x[k], dy = target.y - entities.y[k];
+            // Sent back to a spawn: jump there
+            if (std::fabs(dx) + std::fabs(dy) > 1.5f * TILE_SIZE)
+            {
+                entities.x[k] = target.x;
+                entities.y[k] = target.y;
+                dx = dy = 0;
+            }
+            entities.vx[k] = dx * tickRate;
+            entities.vy[k] = dy * tickRate;
+            if (e.dir != SIM_STOP) entities.state[k] = e.dir;
+        }
+        for (; playChangesSeen < playSim.changes.size(); playChangesSeen++)
+        {
+            std::uint32_t pos = playSim.changes[playChangesSeen].pos;
+            sf::Vector2f p = tileCenter((int)(pos / mapWidth), (int)(pos % mapWidth));
+            entities.KillAt(ENTITYKIND::COIN, p.x, p.y, TILE_SIZE / 4.0f);
+            entities.Burst(p.x, p.y, 12, TILE_SIZE * 4.0f, 0.6f, sf::Color(255, 220, 80));
+        }
+    }
+
+    void UpdatePlay(float dt)
+    {
+        auto start = std::chrono::steady_clock::now();
+        const float tick = 1 / PLAY_TICKS_PER_SECOND;
+        // After a long frame, catch up one tick instead of many
+        playTickTime = std::min(playTickTime + dt, 2 * tick);
+        while (playTickTime >= tick)
+        {
+            playTickTime -= tick;
+            StepPlay();
+        }
+        entities.Step(dt);
+        entities.RemoveDead();
+        entityUpdateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::string getPlayStats()
+    {
+        std::ostringstream ss;
+        std::uint32_t score = 0;
+        for (const SimEntity& e : playSim.state.entities)
+        {
+            if (e.id == playerId) score = e.score;
+        }
+        ss.precision(2);
+        ss << std::fixed << "PLAY (F5, arrows): score " << score << " | " << entities.count() << " entities, "
+            << entities.batchedCount() << " drawn | update " << entityUpdateMs << " ms";
+        return ss.str();
+    }
+
     void Update(float dt, sf::RenderWindow& window)
     {
+        ALLOC_SCOPE("Map::Update");
+        AutosaveTick(dt);
+        UpdateMeshes(window);
+
+        if (GLOBAL_input.playToggleRequested)
+        {
+            GLOBAL_input.playToggleRequested = false;
+            if (playing) StopPlay();
+            else StartPlay();
+        }
+        if (playing) UpdatePlay(dt);
+
+        // Page in what the camera sees, and what it is about to see
+        if (storage == MAPSTORAGE::PAGED)
+        {
+            std::array<int, 4> visible = getVisibleTileRange(window);
+            pager.Update(visible[0], visible[1], visible[2], visible[3], GLOBAL_input.cameraMovAxis.x, GLOBAL_input.cameraMovAxis.y);
+        }
+
         if (game_MODE == MODE::DEBUG)
         {
+            HandleClipboardCommands();
+            if (GLOBAL_input.transformRequested)
+            {
+                GLOBAL_input.transformRequested = false;
+                ApplyTransform(GLOBAL_input.transform);
+            }
+            if (GLOBAL_input.generateRequested)
+            {
+                GLOBAL_input.generateRequested = false;
+                std::uint64_t seed = (std::uint64_t)std::chrono::system_clock::now().time_since_epoch().count();
+                // Overwrites every tile and there is no undo, so ask unless nothing would be lost
+                bool confirmed = true;
+                if (hasUnsavedEdits() || !filePath.empty())
+                {
+                    confirmed = AskYesNo("Generate maze", "Replace every tile of "
+                        + (filePath.empty() ? std::string("the untitled map") : "'" + filePath + "'") + " with a generated maze?");
+                    // Keys released while the box was up never arrive
+                    GLOBAL_input.stopAll();
+                }
+                if (!confirmed) std::cout << "Maze generation cancelled\n";
+                else
+                {
+                    try
+                    {
+                        GenerateMaze(seed);
+                        std::cout << "Generated maze with seed " << seed << "\n";
+                    }
+                    catch (const std::exception& e)
+                    {
+                        std::cout << e.what() << "\n";
+                    }
+                }
+            }
+
             // Row, col of mouse over
-            std::array<int, 2> mouseOver = getTileMousedOver(window);
+            std::array<int, 2> mouseOver = getTileMousedOver();
+            UpdatePathTool(mouseOver);
+            HandleBulkCommands(mouseOver);
             if (mouseOver[0] == -1 || mouseOver[1] == -1) return;
 
-            if (GLOBAL_input.leftClickPressed) {
+            if (isPasting)
+            {
+                if (GLOBAL_input.leftClickJustPressed)
+                {
+                    PasteSymmetric(clipboard, mouseOver[0], mouseOver[1]);
+                    // Stamp keeps the clipboard on the mouse
+                    if (!GLOBAL_input.stampMode) isPasting = false;
+                }
+            }
+            else if (GLOBAL_input.leftClickPressed) {
                 // Left control + click to erase
-                if (GLOBAL_input.controlIsHeld) this->get(mouseOver[0], mouseOver[1])->tileType = TILETYPE::BLANK;
+                if (GLOBAL_input.controlIsHeld) this->PaintTile(mouseOver[0], mouseOver[1], TILETYPE::BLANK);
                 // Click->shifthold->click
-                else if (GLOBAL_input.shiftIsHeld)
+                else if (GLOBAL_input.shiftIsHeld && lastPlaced[0] != -1)
                 {
                     // Draw line
                     //x,y
-                    std::vector<std::array<int, 2>> pixels = getLineFrom(lastPlaced->col, lastPlaced->row, mouseOver[1], mouseOver[0]);
+                    std::vector<std::array<int, 2>> pixels = getLineFrom(lastPlaced[1], lastPlaced[0], mouseOver[1], mouseOver[0]);
                     for (std::array<int, 2> pt : pixels)
                     {
-                        this->get(pt[1], pt[0])->tileType = GLOBAL_input.tileType;
+                        this->PaintTile(pt[1], pt[0], GLOBAL_input.tileType);
                     }
                 }
                 // Set to the new tile type
-                else this->get(mouseOver[0], mouseOver[1])->tileType = GLOBAL_input.tileType;
-                lastPlaced = this->get(mouseOver[0], mouseOver[1]);
+                else this->PaintTile(mouseOver[0], mouseOver[1], GLOBAL_input.tileType);
+                lastPlaced = mouseOver;
             }
             else if (GLOBAL_input.rightClickJustPressed)
             {
-                //this->get(mouseOver[0], mouseOver[1])->tile_ID = TILETYPE::BLANK;
+                // Start a new selection
+                selectionStart = mouseOver;
+                selection = { mouseOver[0], mouseOver[1], mouseOver[0], mouseOver[1] };
+                hasSelection = true;
+            }
+            else if (GLOBAL_input.rightClickPressed && hasSelection)
+            {
+                // Drag selection
+                selection = { std::min(selectionStart[0], mouseOver[0]), std::min(selectionStart[1], mouseOver[1]),
+                    std::max(selectionStart[0], mouseOver[0]), std::max(selectionStart[1], mouseOver[1]) };
             }
         }
     }
 
     void RenderDebug(sf::RenderWindow& window)
     {
+        ALLOC_SCOPE("RenderDebug");
         sf::Vector2f _scale = sf::Vector2f(CAMERA_ZOOM, CAMERA_ZOOM);
         bool drawFront = true;
         sf::Sprite specialRender = sf::Sprite(this->tiletype_Textures[(int)GLOBAL_input.tileType]);
-        std::array<int, 2> mouseOver = getTileMousedOver(window);
+        std::array<int, 2> mouseOver = getTileMousedOver();
         sf::Vector2f cameraPos = sf::Vector2f(CAMERA_X, CAMERA_Y);
 
-        
-        for (int i = 0; i < mapHeight; i++)
+        // Only the regions on screen, one draw call each (regions still being rebuilt show their old mesh)
+        std::array<int, 4> visible = getVisibleTileRange(window);
+        sf::Transform world;
+        world.translate(screenPos - cameraPos);
+        world.scale(_scale);
+        if (visible[2] > visible[0] && visible[3] > visible[1])
         {
-            for (int j = 0; j < mapWidth; j++)
-            {
-                Tile* _tile = this->get(i, j);
-                sf::Sprite _sprite(this->tiletype_Textures[(int)_tile->tileType]);
-                _sprite.setScale(_scale);
-                _sprite.setPosition(screenPos - cameraPos + sf::Vector2f(j * TILE_SIZE* _scale.x, i * TILE_SIZE* _scale.y));
-                // if is selected
-                window.draw(_sprite);
-            } // end col loop
-        } // end row loop
+            meshCache.Draw(window, world, visible[1] / CHUNK_SIZE, visible[0] / CHUNK_SIZE,
+                (visible[3] - 1) / CHUNK_SIZE + 1, (visible[2] - 1) / CHUNK_SIZE + 1);
+        }
+
+        // Every entity on screen in one draw call
+        if (playing)
+        {
+            sf::FloatRect seen(sf::Vector2f((float)visible[1] * TILE_SIZE, (float)visible[0] * TILE_SIZE),
+                sf::Vector2f((float)(visible[3] - visible[1]) * TILE_SIZE, (float)(visible[2] - visible[0]) * TILE_SIZE));
+            entities.BuildVertices(seen);
+            entities.Draw(window, world);
+        }
 
         // Render preview
-        if (lastPlaced != nullptr && GLOBAL_input.shiftIsHeld)
+        if (lastPlaced[0] != -1 && GLOBAL_input.shiftIsHeld)
         {
-            std::vector<std::array<int, 2>> pixels = getLineFrom(lastPlaced->col, lastPlaced->row, mouseOver[1], mouseOver[0]);
+            std::vector<std::array<int, 2>> pixels = getLineFrom(lastPlaced[1], lastPlaced[0], mouseOver[1], mouseOver[0]);
             for (std::array<int, 2> pt : pixels)
             {
                 sf::Sprite _sprite(this->tiletype_Textures[(int)GLOBAL_input.tileType]);
@@ -546,6 +1606,63 @@ public:
 
 
         
+        // Path tool: the visible part of the path
+        if (pathStart[0] != -1 && path.distance >= 0)
+        {
+            sf::RectangleShape step = sf::RectangleShape(sf::Vector2f{ TILE_SIZE * _scale.x, TILE_SIZE * _scale.y });
+            step.setFillColor(sf::Color(0, 255, 255, 90));
+            for (int t : path.tiles)
+            {
+                int i = t / mapWidth, j = t % mapWidth;
+                if (i < visible[0] || i >= visible[2] || j < visible[1] || j >= visible[3]) continue;
+                step.setPosition(screenPos - cameraPos + sf::Vector2f(j * TILE_SIZE * _scale.x, i * TILE_SIZE * _scale.y));
+                window.draw(step);
+            }
+        }
+
+        // Symmetry axes through the middle of the map
+        if (GLOBAL_input.symmetry != SYMMETRY::NONE)
+        {
+            sf::Vector2f mapSize((float)mapWidth * TILE_SIZE * _scale.x, (float)mapHeight * TILE_SIZE * _scale.y);
+            sf::RectangleShape axis;
+            axis.setFillColor(sf::Color::Magenta);
+            if (GLOBAL_input.symmetry != SYMMETRY::VERTICAL)
+            {
+                axis.setSize(sf::Vector2f(2, mapSize.y));
+                axis.setPosition(screenPos - cameraPos + sf::Vector2f(mapSize.x / 2 - 1, 0));
+                window.draw(axis);
+            }
+            if (GLOBAL_input.symmetry != SYMMETRY::HORIZONTAL)
+            {
+                axis.setSize(sf::Vector2f(mapSize.x, 2));
+                axis.setPosition(screenPos - cameraPos + sf::Vector2f(0, mapSize.y / 2 - 1));
+                window.draw(axis);
+            }
+        }
+
+        // Selection outline
+        if (hasSelection)
+        {
+            sf::RectangleShape selectRect = sf::RectangleShape(sf::Vector2f{ (selection[3] - selection[1] + 1) * TILE_SIZE * _scale.x, (selection[2] - selection[0] + 1) * TILE_SIZE * _scale.y });
+            selectRect.setPosition(screenPos - cameraPos + sf::Vector2f(selection[1] * TILE_SIZE * _scale.x, selection[0] * TILE_SIZE * _scale.y));
+            selectRect.setFillColor(sf::Color(255, 255, 0, 40));
+            selectRect.setOutlineColor(sf::Color::Yellow);
+            selectRect.setOutlineThickness(2);
+            window.draw(selectRect);
+        }
+
+        // Paste preview: the cached clipboard texture, one sprite
+        if (isPasting && mouseOver[0] != -1 && mouseOver[1] != -1)
+        {
+            sf::Sprite preview(clipboardPreview);
+            float previewScale = (float)(TILE_SIZE * clipboardPreviewStep);
+            preview.setScale(sf::Vector2f(previewScale * _scale.x, previewScale * _scale.y));
+            preview.setPosition(screenPos - cameraPos + sf::Vector2f(mouseOver[1] * TILE_SIZE * _scale.x, mouseOver[0] * TILE_SIZE * _scale.y));
+            preview.setColor(sf::Color(255, 255, 255, 160));
+            window.draw(preview);
+            return;
+        }
+
         // Draw the selected one  
         if (mouseOver[0] >= 0 && mouseOver[0] <= this->mapHeight - 1 && mouseOver[1] >= 0 && mouseOver[1] <= this->mapWidth - 1)
         {
@@ -563,6 +1680,16 @@ public:
             specialRect.setOutlineColor(sf::Color::Red);
             specialRect.setOutlineThickness(3);
             window.draw(specialRect);
+
+            // Where symmetry painting writes as well
+            std::array<std::array<int, 2>, 4> mirrored;
+            int n = mirroredPoints(mouseOver[0], mouseOver[1], mapHeight, mapWidth, GLOBAL_input.symmetry, mirrored);
+            specialRender.setColor(sf::Color(255, 255, 255, 127));
+            for (int k = 1; k < n; k++)
+            {
+                specialRender.setPosition(screenPos - cameraPos + sf::Vector2f(mirrored[k][1] * TILE_SIZE * _scale.x, mirrored[k][0] * TILE_SIZE * _scale.y));
+                window.draw(specialRender);
+            }
         }
 
         
@@ -570,6 +1697,7 @@ public:
 
     void RenderScaledAt(sf::RenderWindow& window, sf::Vector2f scale)
     {
+        ALLOC_SCOPE("MiniView");
         sf::Vector2f scaledViewSize = sf::Vector2f((float)this->getWidth() * TILE_SIZE*scale.x, (float)this->getHeight() * TILE_SIZE*scale.y);
         sf::Vector2f topLeftViewLoc = sf::Vector2f(window.getSize().x, window.getSize().y) - scaledViewSize;
 
@@ -577,17 +1705,15 @@ public:
         sf::Vector2f scaledCameraSize = sf::Vector2f((float)(window.getSize().x) * scale.x* 1/CAMERA_ZOOM, (float)(window.getSize().y) * scale.y*1/CAMERA_ZOOM);
 
         //sf::Vector2f cameraPos = sf::Vector2f(CAMERA_X, CAMERA_Y);
-        for (int i = 0; i < mapHeight; i++)
+        // The cached minimap texture stretched over the frame (paged maps have none, only the frames are drawn)
+        if (meshCache.isMinimapReady())
         {
-            for (int j = 0; j < mapWidth; j++)
-            {
-                Tile* _tile = this->get(i, j);
-                sf::Sprite _sprite(this->tiletype_Textures[(int)_tile->tileType]);
-                _sprite.setScale(scale);
-                _sprite.setPosition(topLeftViewLoc + sf::Vector2f(j * TILE_SIZE * scale.x, i * TILE_SIZE * scale.y));
-                window.draw(_sprite);
-            } // end col loop
-        } // end row loop
+            sf::Sprite minimap(meshCache.minimap);
+            sf::Vector2u size = meshCache.minimap.getSize();
+            minimap.setScale(sf::Vector2f(scaledViewSize.x / size.x, scaledViewSize.y / size.y));
+            minimap.setPosition(topLeftViewLoc);
+            window.draw(minimap);
+        }
         sf::RectangleShape r = sf::RectangleShape(scaledViewSize);
         r.setFillColor(sf::Color::Transparent);
         r.setOutlineColor(sf::Color::Red);
@@ -606,51 +1732,21 @@ public:
 
 };
 
+// A menu icon. Menu draws every button in one batch, and sets bounds in Menu::Layout
 class Button
 {
-private:
-    sf::RenderWindow* window;
-    sf::Texture _texture;
-    sf::Sprite* _sprite;
 public:
-    int x, y;
-    int sizeX = 32;
-    int sizeY = 32;
-    Button(std::string texturePath, sf::RenderWindow* _win)
-    {
-        if (!_texture.loadFromFile(texturePath)) std::cout << "Error: could not load texture: " << texturePath << "\n";
-        sizeX = _texture.getSize().x;
-        sizeY = _texture.getSize().y;
-        _sprite = new sf::Sprite(_texture);
-        this->window = _win;
-    }
+    // Image index in the menu atlas
+    int icon = 0;
+    // Screen rect in window pixels
+    sf::IntRect bounds;
 
-    bool IsMouseOver()
+    bool IsMouseOver() const
     {
-        sf::Vector2i pixelPos = sf::Mouse::getPosition(*window);        // window coordinates
-        sf::Vector2f mouseCoords = window->mapPixelToCoords(pixelPos);
-
-        int minX = x;
-        int maxX = x + sizeX;
-        int minY = y;
-        int maxY = y + sizeY;
-
-        return mouseCoords.x >= minX && mouseCoords.x <= maxX && mouseCoords.y >= minY && mouseCoords.y <= maxY;
+        return bounds.contains(GLOBAL_input.mousePos);
     }
 
-    void setPosition(int _x, int _y)
-    {
-        this->x = _x;
-        this->y = _y;
-        _sprite->setPosition(sf::Vector2f{ (float)x, (float)y });
-    }
-
-    void Draw()
-    {
-        window->draw(*_sprite);
-    }
-
-    bool CheckIsJustClicked()
+    bool CheckIsJustClicked() const
     { 
         return IsMouseOver() && GLOBAL_input.leftClickJustPressed;
     }
@@ -660,11 +1756,11 @@ public:
 class Menu
 {
 private:
-    Button* config;
-    Button* open;
-    Button* save;
-    Button* _new;
-    Button* resize;
+    Button config;
+    Button open;
+    Button save;
+    Button _new;
+    Button resize;
 
 
     std::vector<Button*> buttons;
@@ -674,6 +1770,23 @@ private:
 
     sf::RenderWindow* window;
     int screenWidth, screenHeight;
+
+    // Every icon in one texture and every button in one vertex array. The vertices are
+    // only rebuilt when the layout or the hovered button changes.
+    TextureAtlas atlas;
+    sf::VertexArray vertices = sf::VertexArray(sf::PrimitiveType::Triangles);
+    int hovered = -1;
+
+    void RebuildVertices()
+    {
+        vertices.clear();
+        for (std::size_t i = 0; i < buttons.size(); i++)
+        {
+            const sf::IntRect& b = buttons[i]->bounds;
+            sf::Color tint = (int)i == hovered ? sf::Color(200, 200, 200) : sf::Color::White;
+            atlas.AppendQuad(vertices, buttons[i]->icon, sf::FloatRect({ (float)b.position.x, (float)b.position.y }, { (float)b.size.x, (float)b.size.y }), tint);
+        }
+    }
 public:
     void Init(sf::RenderWindow* _window, int _screenWidth, int _screenHeight)
     {
@@ -685,32 +1798,56 @@ public:
     void LoadTextures()
     {
         std::cout << "Loading menu textures...\n";
-        config = new Button("menu\\config.png", window);
-        open = new Button("menu\\open.png", window);
-        save = new Button("menu\\save.png", window);
-        resize = new Button("menu\\resize.png", window);
-        _new = new Button("menu\\new.png", window);
-
-        buttons.push_back(_new);
-        buttons.push_back(open);
-        buttons.push_back(resize);
-        buttons.push_back(save);
-
+        if (!atlas.BuildFromFiles({ "menu\\config.png", "menu\\open.png", "menu\\save.png", "menu\\resize.png", "menu\\new.png" }))
+            std::cout << "Error: could not build the menu atlas\n";
+        config.icon = 0;
+        open.icon = 1;
+        save.icon = 2;
+        resize.icon = 3;
+        _new.icon = 4;
+
+        buttons.push_back(&_new);
+        buttons.push_back(&open);
+        buttons.push_back(&resize);
+        buttons.push_back(&save);
+
+        Layout(screenWidth, screenHeight);
         std::cout << "Menu textures loaded.\n";
     }
 
+    // Places the buttons for a window of this size, only needed when it changes
+    void Layout(int _screenWidth, int _screenHeight)
+    {
+        screenWidth = _screenWidth;
+        screenHeight = _screenHeight;
+        for (std::size_t i = 0; i < buttons.size(); i++)
+        {
+            sf::Vector2i size = atlas.rects[buttons[i]->icon].size;
+            buttons[i]->bounds = sf::IntRect({ screenWidth - (int)(32 * (buttons.size() - i)), 0 }, size);
+        }
+        RebuildVertices();
+    }
+
     void Draw()
     {
-        for (int i = 0; i < buttons.size(); i++)
+        ALLOC_SCOPE("Menu::Draw");
+        int nowHovered = -1;
+        for (std::size_t i = 0; i < buttons.size(); i++)
+        {
+            if (buttons[i]->IsMouseOver()) nowHovered = (int)i;
+        }
+        if (nowHovered != hovered)
         {
-            buttons[i]->setPosition(screenWidth-(32*(buttons.size() - i)), 0);
-            buttons[i]->Draw();
+            hovered = nowHovered;
+            RebuildVertices();
         }
+        window->draw(vertices, sf::RenderStates(&atlas.texture));
     }
 
     void Update(float dt, Map& _map)
     {
-        if (_new->CheckIsJustClicked())
+        ALLOC_SCOPE("Menu::Update");
+        if (_new.CheckIsJustClicked())
         {
             ResizeDialog_InputData data;
 
@@ -727,12 +1864,30 @@ public:
                 std::cout << "A: " << data.a << "\n";
                 std::cout << "B: " << data.b << "\n";
             }
-            _map.Clear();
-            _map.CreateBlank(data.b, data.a);
+            if ((long long)data.a * data.b > MAX_INMEMORY_TILES)
+            {
+                // Too big for memory, back it with a .pmap file
+                std::string path = SaveFileDialog(
+                    "Paged maps (*.pmap)\0*.pmap\0"
+                );
+                if (!path.empty())
+                {
+                    if (!hasExtension(path, ".pmap")) path += ".pmap";
+                    _map.CreatePaged(path, data.b, data.a);
+                    _map.StartAutosave(false);
+                }
+            }
+            else
+            {
+                _map.Clear();
+                _map.CreateBlank(data.b, data.a, newMapStorage);
+                _map.filePath.clear();
+                _map.StartAutosave(false);
+            }
             CAMERA_X = 0;
             CAMERA_Y = 0;
         }
-        else if (resize->CheckIsJustClicked())
+        else if (resize.CheckIsJustClicked())
         {
             ResizeDialog_InputData data;
 
@@ -750,10 +1905,11 @@ public:
                 std::cout << "B: " << data.b << "\n";
             }
         }
-        else if (save->CheckIsJustClicked())
+        else if (save.CheckIsJustClicked())
         {
             std::string path = SaveFileDialog(
                 "CSV Files (*.csv)\0*.csv\0"
+                "Paged maps (*.pmap)\0*.pmap\0"
             );
 
             if (!path.empty())
@@ -762,10 +1918,11 @@ public:
             }
             _map.SaveToFile(path);
         }
-        else if (open->CheckIsJustClicked())
+        else if (open.CheckIsJustClicked())
         {
             std::string path = OpenFileDialog(
                 "CSV Files (*.csv)\0*.csv\0"
+                "Paged maps (*.pmap)\0*.pmap\0"
                 "All Files (*.*)\0*.*\0"
             );
 
@@ -774,7 +1931,8 @@ public:
                 std::cout << "Selected: " << path << "\n";
             }
             GLOBAL_input.stopAll();
-            _map.LoadFromFile(path);
+            _map.LoadFromFile(path, newMapStorage);
+            if (_map.filePath == path) _map.StartAutosave(true);
             CAMERA_X = 0;
             CAMERA_Y = 0;
         }
@@ -782,13 +1940,209 @@ public:
 
 };
 
+// Map browser (B): every map in MAPS_DIRECTORY from its catalogue, filtered as you type
+// (see CatalogueFilter). Up/Down select, Enter opens, Esc closes. While open it takes
+// all key presses and clicks.
+const char* const MAPS_DIRECTORY = "MAPS";
+const int BROWSER_LINES = 16;
+
+class MapBrowser
+{
+private:
+    MapCatalogue catalogue;
+    std::string filterText;
+    // Catalogue indices of the entries passing the filter
+    std::vector<int> shown;
+    int selected = 0;
+    // The B that opened the browser also arrives as text
+    bool skipText = false;
+    sf::Texture thumbnail;
+    int thumbnailFor = -1;
+    // Rescan of MAPS_DIRECTORY on a worker thread into scanned, swapped in by PollScan
+    std::thread scanThread;
+    std::atomic<bool> scanDone{ false };
+    MapCatalogue scanned;
+
+    void Refilter()
+    {
+        shown = catalogue.Find(CatalogueFilter(filterText));
+        selected = std::max(0, std::min(selected, (int)shown.size() - 1));
+    }
+
+    // Uploads the selected entry's thumbnail, one pixel per thumbnail tile
+    void UpdateThumbnail(const Map& map)
+    {
+        int id = shown.empty() ? -1 : shown[selected];
+        if (id == thumbnailFor) return;
+        thumbnailFor = id;
+        if (id == -1 || catalogue.entries[id].thumbnail.empty()) return;
+        const CatalogueEntry& e = catalogue.entries[id];
+        std::vector<std::uint8_t> pixels(e.thumbnail.size() * 4);
+        for (std::size_t i = 0; i < e.thumbnail.size(); i++)
+        {
+            sf::Color c = e.thumbnail[i] < TILETYPE_LEN ? map.tiletype_Colors[e.thumbnail[i]] : sf::Color::Magenta;
+            pixels[i * 4 + 0] = c.r;
+            pixels[i * 4 + 1] = c.g;
+            pixels[i * 4 + 2] = c.b;
+            pixels[i * 4 + 3] = 255;
+        }
+        if (!thumbnail.loadFromImage(sf::Image({ (unsigned)e.thumbWidth, (unsigned)e.thumbHeight }, pixels.data())))
+            std::cout << "Error: could not create the map thumbnail\n";
+    }
+
+    bool isScanning() const { return scanThread.joinable(); }
+
+    // Rescans the directory in the background (only new and changed maps are read)
+    void StartScan()
+    {
+        if (isScanning()) return;
+        scanDone = false;
+        scanThread = std::thread([this]
+        {
+            scanned = MapCatalogue();
+            scanned.Scan(MAPS_DIRECTORY);
+            scanDone = true;
+        });
+    }
+
+    // Swaps in the finished rescan, keeping the selected map selected
+    void PollScan()
+    {
+        if (!isScanning() || !scanDone) return;
+        scanThread.join();
+        const CatalogueScanStats& stats = scanned.lastScan;
+        std::cout << "Catalogue of '" << MAPS_DIRECTORY << "': " << stats.files << " maps, " << stats.indexed << " indexed, "
+            << stats.reused << " unchanged, " << stats.failed << " unreadable (" << stats.ms << " ms)\n";
+
+        std::string selectedName = shown.empty() ? std::string() : catalogue.entries[shown[selected]].name;
+        catalogue = std::move(scanned);
+        thumbnailFor = -1;
+        Refilter();
+        for (int i = 0; i < (int)shown.size(); i++)
+        {
+            if (catalogue.entries[shown[i]].name == selectedName) selected = i;
+        }
+    }
+
+public:
+    bool isOpen = false;
+
+    ~MapBrowser()
+    {
+        if (scanThread.joinable()) scanThread.join();
+    }
+
+    // Shows the browser with the maps as last catalogued, and rescans behind it
+    void Open()
+    {
+        PollScan();
+        if (catalogue.entries.empty()) catalogue.Load(MAPS_DIRECTORY);
+        StartScan();
+        filterText.clear();
+        selected = 0;
+        thumbnailFor = -1;
+        Refilter();
+        GLOBAL_input.stopAll();
+        skipText = true;
+        isOpen = true;
+    }
+
+    // Returns true if the browser used the event
+    bool HandleEvent(const sf::Event& event, Map& map)
+    {
+        if (const auto* text = event.getIf<sf::Event::TextEntered>())
+        {
+            if (skipText)
+            {
+                skipText = false;
+                return true;
+            }
+            if (text->unicode == 8)
+            {
+                if (!filterText.empty()) filterText.pop_back();
+            }
+            else if (text->unicode >= 32 && text->unicode < 127) filterText += (char)text->unicode;
+            Refilter();
+            return true;
+        }
+        if (const auto* key = event.getIf<sf::Event::KeyPressed>())
+        {
+            skipText = false;
+            if (key->code == sf::Keyboard::Key::Escape) isOpen = false;
+            else if (key->code == sf::Keyboard::Key::Up) selected = std::max(0, selected - 1);
+            else if (key->code == sf::Keyboard::Key::Down) selected = std::max(0, std::min(selected + 1, (int)shown.size() - 1));
+            else if (key->code == sf::Keyboard::Key::Enter && !shown.empty())
+            {
+                // Same as the open button
+                std::string path = (std::filesystem::path(MAPS_DIRECTORY) / catalogue.entries[shown[selected]].name).string();
+                isOpen = false;
+                GLOBAL_input.stopAll();
+                map.LoadFromFile(path, newMapStorage);
+                if (map.filePath == path) map.StartAutosave(true);
+                CAMERA_X = 0;
+                CAMERA_Y = 0;
+            }
+            return true;
+        }
+        return event.is<sf::Event::MouseButtonPressed>();
+    }
+
+    void Draw(sf::RenderWindow& window, TextDraw& text, const Map& map)
+    {
+        ALLOC_SCOPE("MapBrowser::Draw");
+        const int x = 250, y = 40, lineHeight = 22;
+        sf::RectangleShape panel(sf::Vector2f{ 760, (float)(lineHeight * (BROWSER_LINES + 3)) });
+        panel.setPosition(sf::Vector2f{ (float)x - 10, (float)y - 5 });
+        panel.setFillColor(sf::Color(0, 0, 0, 200));
+        window.draw(panel);
+
+        PollScan();
+        const CatalogueScanStats& scan = catalogue.lastScan;
+        text.DrawText("maps (B): " + filterText + "_", x, y, 20, sf::Color::White);
+        text.DrawText(std::to_string(shown.size()) + "/" + std::to_string(catalogue.entries.size()) + " maps | "
+            + (isScanning() ? std::string("scanning...") : "scan " + std::to_string((int)scan.ms) + " ms, " + std::to_string(scan.indexed) + " indexed"),
+            x, y + lineHeight, 18, sf::Color(180, 180, 180));
+
+        // Scrolls to keep the selection visible
+        int first = std::max(0, std::min(selected - BROWSER_LINES / 2, (int)shown.size() - BROWSER_LINES));
+        for (int i = first; i < std::min((int)shown.size(), first + BROWSER_LINES); i++)
+        {
+            const CatalogueEntry& e = catalogue.entries[shown[i]];
+            std::string line = e.name + "  ";
+            if (e.ok)
+            {
+                line += std::to_string(e.rows) + "x" + std::to_string(e.cols)
+                    + "  coins " + std::to_string(e.histogram[(int)TILETYPE::COIN])
+                    + "  ghosts " + std::to_string(e.histogram[(int)TILETYPE::GHOSTSPAWN]);
+            }
+            else line += "(" + e.error + ")";
+            sf::Color color = i == selected ? sf::Color::Yellow : (e.ok ? sf::Color::White : sf::Color(150, 150, 150));
+            text.DrawText((i == selected ? "> " : "  ") + line, x, y + lineHeight * (i - first + 2), 18, color);
+        }
+
+        UpdateThumbnail(map);
+        if (thumbnailFor != -1 && !catalogue.entries[thumbnailFor].thumbnail.empty())
+        {
+            const float size = 160;
+            sf::Vector2u px = thumbnail.getSize();
+            sf::Sprite sprite(thumbnail);
+            sprite.setScale(sf::Vector2f{ size / std::max(px.x, px.y), size / std::max(px.x, px.y) });
+            sprite.setPosition(sf::Vector2f{ (float)x + 580, (float)y + lineHeight * 2 });
+            window.draw(sprite);
+        }
+    }
+};
+
 Map _map;
+MapBrowser mapBrowser;
 
 // Updates event flags in Global_input
 void HandleInput(std::optional<sf::Event>& event, float dt)
 {
+    ALLOC_SCOPE("HandleInput");
     GLOBAL_input.leftClickJustPressed = false;
     GLOBAL_input.rightClickJustPressed = false;
+    if (mapBrowser.isOpen && mapBrowser.HandleEvent(*event, _map)) return;
     // Handle key press
     if (event->is < sf::Event::KeyPressed>())
     {
@@ -826,6 +2180,48 @@ void HandleInput(std::optional<sf::Event>& event, float dt)
             GLOBAL_input.cameraMovAxis.x = 1;
         }
         else if (keyEvent->code == sf::Keyboard::Key::LShift) GLOBAL_input.shiftIsHeld = true;
+        // Clipboard
+        else if (keyEvent->code == sf::Keyboard::Key::C && GLOBAL_input.controlIsHeld) GLOBAL_input.copyRequested = true;
+        else if (keyEvent->code == sf::Keyboard::Key::X && GLOBAL_input.controlIsHeld) GLOBAL_input.cutRequested = true;
+        else if (keyEvent->code == sf::Keyboard::Key::V && GLOBAL_input.controlIsHeld) GLOBAL_input.pasteRequested = true;
+        else if (keyEvent->code == sf::Keyboard::Key::Escape) GLOBAL_input.cancelRequested = true;
+        // Transforms
+        else if (keyEvent->code == sf::Keyboard::Key::H) { GLOBAL_input.transform = MAPTRANSFORM::FLIP_H; GLOBAL_input.transformRequested = true; }
+        else if (keyEvent->code == sf::Keyboard::Key::V) { GLOBAL_input.transform = MAPTRANSFORM::FLIP_V; GLOBAL_input.transformRequested = true; }
+        else if (keyEvent->code == sf::Keyboard::Key::R)
+        {
+            GLOBAL_input.transform = GLOBAL_input.shiftIsHeld ? MAPTRANSFORM::ROTATE_CCW : MAPTRANSFORM::ROTATE_CW;
+            GLOBAL_input.transformRequested = true;
+        }
+        else if (keyEvent->code == sf::Keyboard::Key::T && GLOBAL_input.controlIsHeld) { GLOBAL_input.transform = MAPTRANSFORM::TRANSPOSE; GLOBAL_input.transformRequested = true; }
+        else if (keyEvent->code == sf::Keyboard::Key::M) GLOBAL_input.symmetry = static_cast<SYMMETRY>(((int)GLOBAL_input.symmetry + 1) % symmetryString.size());
+        else if (keyEvent->code == sf::Keyboard::Key::T) GLOBAL_input.stampMode = !GLOBAL_input.stampMode;
+        else if (keyEvent->code == sf::Keyboard::Key::F) GLOBAL_input.pathRequested = true;
+        else if (keyEvent->code == sf::Keyboard::Key::G && GLOBAL_input.controlIsHeld) GLOBAL_input.generateRequested = true;
+        else if (keyEvent->code == sf::Keyboard::Key::B) mapBrowser.Open();
+        else if (keyEvent->code == sf::Keyboard::Key::F5) GLOBAL_input.playToggleRequested = true;
+        // Bulk operations
+        else if (keyEvent->code == sf::Keyboard::Key::K) GLOBAL_input.histogramRequested = true;
+        else if (keyEvent->code == sf::Keyboard::Key::J)
+        {
+            GLOBAL_input.replaceRequested = true;
+            GLOBAL_input.replaceOnBorder = GLOBAL_input.shiftIsHeld;
+        }
+        // Pac-Man in PLAY mode
+        else if (keyEvent->code == sf::Keyboard::Key::Up) GLOBAL_input.playDirection = 0;
+        else if (keyEvent->code == sf::Keyboard::Key::Down) GLOBAL_input.playDirection = 1;
+        else if (keyEvent->code == sf::Keyboard::Key::Left) GLOBAL_input.playDirection = 2;
+        else if (keyEvent->code == sf::Keyboard::Key::Right) GLOBAL_input.playDirection = 3;
+        // Allocation history so far
+        else if (keyEvent->code == sf::Keyboard::Key::F9 && AllocTracker::isEnabled())
+        {
+            if (allocTracker.ExportCsv("alloc_stats.csv")) std::cout << "Wrote alloc_stats.csv\n";
+        }
+        // Toggle layout for the next new/opened map
+        else if (keyEvent->code == sf::Keyboard::Key::L)
+        {
+            newMapStorage = newMapStorage == MAPSTORAGE::PACKED ? MAPSTORAGE::POINTERGRID : MAPSTORAGE::PACKED;
+        }
         if (keyEvent->code == sf::Keyboard::Key::LControl) GLOBAL_input.controlIsHeld = true;
 
     }
@@ -859,7 +2255,10 @@ void HandleInput(std::optional<sf::Event>& event, float dt)
             GLOBAL_input.leftClickJustPressed = true;
             GLOBAL_input.leftClickPressed = true;
         }
-        else if (mouseEvent->button == sf::Mouse::Button::Right) GLOBAL_input.rightClickJustPressed = true;
+        else if (mouseEvent->button == sf::Mouse::Button::Right) {
+            GLOBAL_input.rightClickJustPressed = true;
+            GLOBAL_input.rightClickPressed = true;
+        }
         else if (mouseEvent->button == sf::Mouse::Button::Middle) GLOBAL_input.middleButtonHeld = true;
     }
     else if (event->is<sf::Event::MouseButtonReleased>())
@@ -910,8 +2309,16 @@ void UpdateCamera(float dt)
 
 }
 
+// The view follows the window size so window pixels stay world pixels, and the menu is laid out again
+void OnResized(sf::Vector2u size)
+{
+    window->setView(sf::View(sf::FloatRect({ 0, 0 }, { (float)size.x, (float)size.y })));
+    menu.Layout((int)size.x, (int)size.y);
+}
+
 void Update(float dt)
 {
+    GLOBAL_input.mousePos = sf::Mouse::getPosition(*window);
     UpdateCamera(dt);
     _map.Update(dt, *window);
     menu.Update(dt, _map);
@@ -928,33 +2335,748 @@ void Draw()
     _map.RenderDebug(*window);
     textDraw.DrawText("Selected: " + tileTypeString[(int)GLOBAL_input.tileType], 0, 0, 22, sf::Color::Red);
     textDraw.DrawText(std::string("current map:") + std::to_string(_map.getWidth()) + "x" + std::to_string(_map.getHeight()), 0, 22, 22, sf::Color::Red);
+    textDraw.DrawText(std::string("new map layout (L): ") + (newMapStorage == MAPSTORAGE::PACKED ? "packed" : "pointer grid")
+        + " | tiles: " + std::to_string(_map.getMemoryBytes() / 1024) + " KB", 0, 44, 22, sf::Color::Red);
+    if (GLOBAL_input.stampMode) textDraw.DrawText("stamp mode (T)", 0, 66, 22, sf::Color::Red);
+    if (_map.storage == MAPSTORAGE::PAGED) textDraw.DrawText(_map.getPageCacheStats(), 0, 88, 22, sf::Color::Red);
+    if (_map.pathStart[0] != -1) textDraw.DrawText(_map.getPathStats(), 0, 110, 22, sf::Color::Red);
+    if (AllocTracker::isEnabled()) textDraw.DrawText(allocTracker.getOverlayText(), 0, 132, 22, sf::Color::Red);
+    textDraw.DrawText(_map.getMeshStats(), 0, 154, 22, sf::Color::Red);
+    if (_map.typeIndex.isBuilt()) textDraw.DrawText(_map.getTileCountStats(), 0, 198, 22, sf::Color::Red);
+    if (GLOBAL_input.symmetry != SYMMETRY::NONE) textDraw.DrawText("symmetry (M): " + symmetryString[(int)GLOBAL_input.symmetry], 0, 176, 22, sf::Color::Red);
+    if (_map.playing) textDraw.DrawText(_map.getPlayStats(), 0, 220, 22, sf::Color::Red);
+    if (!_map.bulkStatus.empty()) textDraw.DrawText(_map.bulkStatus, 0, 242, 22, sf::Color::Red);
     
     // Render mini view of map
     DrawMiniView(&_map, window);
     
     // Render ui
     menu.Draw();
+    if (mapBrowser.isOpen) mapBrowser.Draw(*window, textDraw, _map);
 }
 
-int main()
+// Loads a map file into a TileBlock, through the same loader as the editor
+TileBlock LoadMapBlock(std::string path)
 {
-    
+    Map map;
+    map.indexTiles = false;
+    map.LoadFromFile(path, MAPSTORAGE::PACKED);
+    if (!map.isInitialized) throw std::runtime_error("Error: could not load '" + path + "'");
+    return map.CopyRegion(0, 0, map.getHeight(), map.getWidth());
+}
+
+// Saves a TileBlock through Map::SaveToFile (.csv or .pmap)
+void SaveMapBlock(const TileBlock& block, std::string path)
+{
+    Map map;
+    map.CreatePacked(block.rows, block.cols);
+    map.PasteRegion(block, 0, 0);
+    map.SaveToFile(path);
+}
+
+double msSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Headless game server (--server): ticks forever at ticksPerSecond, stats every 5 seconds
+int RunGameServer(std::string mapPath, std::uint16_t port, std::uint32_t ticksPerSecond)
+{
+    GameServer server;
+    server.ticksPerSecond = ticksPerSecond;
+    port = server.Start(LoadMapBlock(mapPath), port);
+    if (port == 0) throw std::runtime_error("Error: could not listen on 127.0.0.1");
+    std::cout << "server: '" << mapPath << "' on 127.0.0.1:" << port << " at " << ticksPerSecond << " ticks/s\n";
+
+    auto next = std::chrono::steady_clock::now();
+    auto lastReport = next;
+    while (true)
+    {
+        server.Tick();
+        next += std::chrono::microseconds(1000000 / ticksPerSecond);
+        std::this_thread::sleep_until(next);
+        if (std::chrono::steady_clock::now() - lastReport > std::chrono::seconds(5))
+        {
+            std::cout << server.getStatsText() << "\n";
+            lastReport = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+// Bot client (--client): plays on a local server until it has seen ticks snapshots
+int RunBotClient(std::uint16_t port, int ticks)
+{
+    BotClient bot((std::uint64_t)std::chrono::steady_clock::now().time_since_epoch().count());
+    if (!bot.Connect(port)) throw std::runtime_error("Error: could not connect to 127.0.0.1:" + std::to_string(port));
+    while (bot.isConnected() && !bot.failed && bot.snapshots < (std::uint64_t)ticks)
+    {
+        bot.Update();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::uint32_t score = 0;
+    for (const SimEntity& e : bot.state.entities)
+    {
+        if (e.id == bot.entity) score = e.score;
+    }
+    std::cout << "client: " << bot.snapshots << " snapshots, " << bot.bytesReceived() / std::max<std::uint64_t>(1, bot.snapshots)
+        << " bytes/tick, score " << score << (bot.failed ? ", got a bad snapshot" : "") << "\n";
+    return bot.failed ? 1 : 0;
+}
+
+// Server and bots in this process over real loopback sockets, unthrottled (--loopback-test).
+// Fails unless every bot ends up with exactly the server's state.
+int RunLoopbackTest(std::string mapPath, int clientCount, int ticks)
+{
+    GameServer server;
+    std::uint16_t port = server.Start(LoadMapBlock(mapPath), 0);
+    if (port == 0) throw std::runtime_error("Error: could not listen on 127.0.0.1");
+    std::deque<BotClient> bots;
+    for (int i = 0; i < clientCount; i++)
+    {
+        bots.emplace_back(i + 1);
+        if (!bots.back().Connect(port)) throw std::runtime_error("Error: could not connect to 127.0.0.1:" + std::to_string(port));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < ticks; t++)
+    {
+        server.Tick();
+        for (BotClient& bot : bots) bot.Update();
+    }
+    // Let every bot catch up with the last tick
+    for (int round = 0; round < 2000; round++)
+    {
+        bool behind = false;
+        for (BotClient& bot : bots)
+        {
+            bot.Update();
+            behind |= bot.state.tick != server.sim.state.tick;
+        }
+        if (!behind) break;
+        if (round % 100 == 99) server.SendSnapshots();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double ms = msSince(start);
+
+    int mismatched = 0;
+    std::uint64_t hash = server.sim.state.Hash();
+    for (BotClient& bot : bots) mismatched += bot.failed || bot.state.Hash() != hash;
+    std::cout << server.getStatsText() << "\n";
+    std::cout << "loopback: " << clientCount << " clients, " << ticks << " ticks in " << ms << " ms, "
+        << clientCount - mismatched << "/" << clientCount << " clients match the server state\n";
+    return mismatched == 0 ? 0 : 1;
+}
+
+// Prints the tile counts of a map file and what keeps it from being playable (exit code 1 if anything)
+int ValidateMapFile(std::string path)
+{
+    Map map;
+    auto start = std::chrono::steady_clock::now();
+    map.LoadFromFile(path, MAPSTORAGE::PACKED);
+    if (!map.isInitialized) throw std::runtime_error("Error: could not load '" + path + "'");
+    std::cout << "validate: loaded and indexed in " << msSince(start) << " ms\n";
+    for (int t = 0; t < TILETYPE_LEN; t++) std::cout << "  " << tileTypeString[t] << ": " << map.CountTiles(static_cast<TILETYPE>(t)) << "\n";
+    std::vector<std::string> problems = map.ValidateMap();
+    for (const std::string& problem : problems) std::cout << "map " << problem << "\n";
+    if (problems.empty()) std::cout << "map is playable\n";
+    return problems.empty() ? 0 : 1;
+}
+
+// Brings the catalogue of dir up to date and lists the maps passing filter (see CatalogueFilter)
+int ListMapCatalogue(std::string dir, std::string filter)
+{
+    MapCatalogue catalogue;
+    CatalogueScanStats stats = catalogue.Scan(dir);
+    std::cout << "catalogue: " << stats.files << " maps, " << stats.indexed << " indexed, " << stats.reused << " unchanged, "
+        << stats.removed << " removed, " << stats.failed << " unreadable in " << stats.ms << " ms\n";
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int> found = catalogue.Find(CatalogueFilter(filter));
+    double findMs = msSince(start);
+    for (int id : found)
+    {
+        const CatalogueEntry& e = catalogue.entries[id];
+        if (!e.ok)
+        {
+            std::cout << "  " << e.name << ": " << e.error << "\n";
+            continue;
+        }
+        std::cout << "  " << e.name << ": " << e.rows << "x" << e.cols;
+        for (int t = 1; t < TILETYPE_LEN; t++) std::cout << " " << tileTypeString[t] << " " << e.histogram[t];
+        std::cout << " hash " << std::hex << e.hash << std::dec << "\n";
+    }
+    std::cout << found.size() << " of " << catalogue.entries.size() << " maps match (" << findMs << " ms)\n";
+    return 0;
+}
+
+// Tile textures as CPU images (no GPU needed)
+std::vector<TileImage> LoadTileImages()
+{
+    std::vector<TileImage> images;
+    for (int i = 0; i < tileTypeString.size(); i++)
+    {
+        sf::Image image;
+        if (!image.loadFromFile("tiles/" + tileTypeString[i] + ".png"))
+            throw std::runtime_error("Tile sprite" + tileTypeString[i] + ".png" + " not found");
+        TileImage tile;
+        tile.width = (int)image.getSize().x;
+        tile.height = (int)image.getSize().y;
+        tile.pixels.assign(image.getPixelsPtr(), image.getPixelsPtr() + (std::size_t)tile.width * tile.height * 4);
+        images.push_back(std::move(tile));
+    }
+    return images;
+}
+
+// Renders a map file to a png on the CPU.
+// pixelsPerTile >= 1 for full exports, or maxThumbnailSize > 0 for a thumbnail that fits in that many pixels
+int ExportMapImage(std::string mapPath, std::string outPath, int pixelsPerTile, int maxThumbnailSize)
+{
+    Map map;
+    map.indexTiles = false;
+    map.LoadFromFile(mapPath, MAPSTORAGE::PACKED);
+    if (!map.isInitialized) throw std::runtime_error("Error: could not load '" + mapPath + "'");
+    int rows = map.getHeight();
+    int cols = map.getWidth();
+
+    // Paged maps fault chunks in while reading, so they are read from one thread
+    int threads = map.storage == MAPSTORAGE::PAGED ? 1 : 0;
+    MapRowReader readRow = [&map, cols](int r, std::uint8_t* out) { map.ReadRow(r, 0, cols, out); };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::uint8_t> pixels;
+    // Checked in 64 bits before anything is allocated
+    std::uint64_t imageWidth, imageHeight;
+    int tilesPerPixel = 1;
+    bool fits;
+    if (maxThumbnailSize > 0)
+    {
+        tilesPerPixel = std::max(1, (std::max(rows, cols) + maxThumbnailSize - 1) / maxThumbnailSize);
+        fits = exportImageSize((rows + tilesPerPixel - 1) / tilesPerPixel, (cols + tilesPerPixel - 1) / tilesPerPixel, 1, imageWidth, imageHeight);
+    }
+    else fits = exportImageSize(rows, cols, pixelsPerTile, imageWidth, imageHeight);
+    if (!fits)
+    {
+        throw std::runtime_error("Error: a " + std::to_string(imageWidth) + "x" + std::to_string(imageHeight) + " image is too big (at most "
+            + std::to_string(EXPORT_MAX_SIDE) + " pixels a side and " + std::to_string(EXPORT_MAX_PIXELS) + " pixels in all)");
+    }
+    unsigned width = (unsigned)imageWidth, height = (unsigned)imageHeight;
+
+    if (maxThumbnailSize > 0) pixels = CompositeThumbnail(rows, cols, readRow, BuildTilePalette(LoadTileImages(), 1), tilesPerPixel, threads);
+    else pixels = CompositeMap(rows, cols, readRow, BuildTilePalette(LoadTileImages(), pixelsPerTile), threads);
+    std::cout << "export: composited " << width << "x" << height << " in " << msSince(start) << " ms on " << workerCount(threads) << " threads\n";
+
+    sf::Image image({ width, height }, pixels.data());
+    if (!image.saveToFile(outPath))
+    {
+        std::cerr << "Failed to write '" << outPath << "'\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Generates a maze straight into a map of the right layout and saves it (.csv or .pmap)
+int GenerateMapFile(std::string outPath, int rows, int cols, std::uint64_t seed)
+{
+    Map map;
+    if (hasExtension(outPath, ".pmap")) map.CreatePaged(outPath, rows, cols);
+    else map.CreatePacked(rows, cols);
+
+    auto start = std::chrono::steady_clock::now();
+    map.GenerateMaze(seed);
+    std::cout << "generate: " << rows << "x" << cols << " maze (seed " << seed << ") in " << msSince(start) << " ms\n";
+    map.SaveToFile(outPath);
+    return 0;
+}
+
+// Plain breadth first search over tiles, the baseline --bench-path compares against
+int GridDistance(const std::vector<std::uint8_t>& walkable, int rows, int cols, int start, int goal, std::vector<int>& dist, std::vector<int>& queue)
+{
+    std::fill(dist.begin(), dist.end(), -1);
+    queue.clear();
+    dist[start] = 0;
+    queue.push_back(start);
+    for (std::size_t i = 0; i < queue.size(); i++)
+    {
+        int t = queue[i];
+        if (t == goal) return dist[t];
+        int r = t / cols, c = t % cols;
+        int next[4] = { r > 0 ? t - cols : -1, r < rows - 1 ? t + cols : -1, c > 0 ? t - 1 : -1, c < cols - 1 ? t + 1 : -1 };
+        for (int n : next)
+        {
+            if (n == -1 || !walkable[n] || dist[n] != -1) continue;
+            dist[n] = dist[t] + 1;
+            queue.push_back(n);
+        }
+    }
+    return -1;
+}
+
+// Times junction graph queries against grid BFS on random walkable pairs of a map
+int BenchPath(std::string mapPath, int queries)
+{
+    Map map;
+    map.LoadFromFile(mapPath, MAPSTORAGE::PACKED);
+    if (!map.isInitialized) throw std::runtime_error("Error: could not load '" + mapPath + "'");
+    int rows = map.getHeight(), cols = map.getWidth();
+
+    auto start = std::chrono::steady_clock::now();
+    map.BuildPathGraph();
+    std::cout << "bench-path: graph built in " << msSince(start) << " ms\n";
+    const std::vector<std::uint8_t>& walkable = map.pathGraph.walkable;
+
+    std::vector<int> open;
+    for (int t = 0; t < rows * cols; t++)
+    {
+        if (walkable[t]) open.push_back(t);
+    }
+    if (open.empty()) throw std::runtime_error("Error: map has no walkable tiles");
+    std::mt19937 rng(1234);
+    std::vector<std::array<int, 2>> pairs(queries);
+    for (std::array<int, 2>& p : pairs) p = { open[rng() % open.size()], open[rng() % open.size()] };
+
+    std::vector<int> graphDist(queries), gridDist(queries);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < queries; i++) graphDist[i] = map.pathGraph.FindPath(pairs[i][0], pairs[i][1]).distance;
+    double graphMs = msSince(start);
+
+    std::vector<int> dist((std::size_t)rows * cols), queue;
+    queue.reserve((std::size_t)rows * cols);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < queries; i++) gridDist[i] = GridDistance(walkable, rows, cols, pairs[i][0], pairs[i][1], dist, queue);
+    double gridMs = msSince(start);
+
+    int mismatches = 0;
+    for (int i = 0; i < queries; i++) mismatches += graphDist[i] != gridDist[i];
+    std::cout << "bench-path: " << queries << " queries, graph " << graphMs / queries << " ms/query, grid BFS "
+        << gridMs / queries << " ms/query (" << gridMs / std::max(graphMs, 1e-9) << "x)\n";
+    if (mismatches > 0)
+    {
+        std::cerr << "bench-path: " << mismatches << " distances differ from grid BFS\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Loads a map as a pointer grid and as a packed grid and compares their memory use, load time,
+// random getType lookups and whole row reads (ReadRow, what meshing and saving use)
+int BenchLayout(std::string mapPath, int lookups)
+{
+    struct Layout { const char* name; MAPSTORAGE storage; };
+    const std::array<Layout, 2> layouts = { { { "pointer grid", MAPSTORAGE::POINTERGRID }, { "packed      ", MAPSTORAGE::PACKED } } };
+    std::array<std::uint64_t, 2> checksums = {};
+    std::cout << "bench-layout: '" << mapPath << "', " << lookups << " random lookups\n";
+    for (int k = 0; k < (int)layouts.size(); k++)
+    {
+        Map map;
+        map.indexTiles = false;
+        auto start = std::chrono::steady_clock::now();
+        map.LoadFromFile(mapPath, layouts[k].storage);
+        if (!map.isInitialized) throw std::runtime_error("Error: could not load '" + mapPath + "'");
+        double loadMs = msSince(start);
+        int rows = map.getHeight(), cols = map.getWidth();
+        double tiles = (double)rows * cols;
+
+        // Same positions for both layouts
+        std::mt19937 rng(1234);
+        std::vector<std::array<int, 2>> points(lookups);
+        for (std::array<int, 2>& p : points) p = { (int)(rng() % rows), (int)(rng() % cols) };
+        std::uint64_t checksum = 0;
+        start = std::chrono::steady_clock::now();
+        for (const std::array<int, 2>& p : points) checksum = checksum * 31 + (std::uint64_t)map.getType(p[0], p[1]);
+        double randomMs = msSince(start);
+
+        std::vector<std::uint8_t> row(cols);
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rows; r++)
+        {
+            map.ReadRow(r, 0, cols, row.data());
+            for (std::uint8_t t : row) checksum = checksum * 31 + t;
+        }
+        double rowsMs = msSince(start);
+        checksums[k] = checksum;
+
+        std::size_t bytes = map.getMemoryBytes();
+        std::cout << "  " << layouts[k].name << "  " << bytes / 1024 << " KB (" << bytes / tiles << " bytes/tile) | load " << loadMs
+            << " ms | getType " << randomMs * 1e6 / lookups << " ns | rows " << rowsMs << " ms (" << rowsMs * 1e6 / tiles << " ns/tile)\n";
+    }
+    if (checksums[0] != checksums[1])
+    {
+        std::cerr << "bench-layout: the layouts read back different tiles\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Animates count entities of every kind for frames 60 Hz frames, with particles dying
+// and being replaced, and reports the update, batching and draw cost per frame. Draws go
+// to an offscreen target sized like the default window, showing every entity.
+int BenchEntities(int count, int frames)
+{
+    const float dt = 1 / 60.0f;
+    const float worldSize = 4096;
+    EntityStore store;
+    sf::RenderTexture target;
+    if (!target.resize({ 1280, 720 })) throw std::runtime_error("Error: could not create the offscreen target");
+    if (!store.LoadAtlas()) throw std::runtime_error("Error: could not build the entity atlas");
+    store.Reserve(count);
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> position(0, worldSize), velocity(-64, 64), lifetime(0.5f, 2);
+    auto spawn = [&](ENTITYKIND k)
+    {
+        std::size_t id = store.Add(k, position(rng), position(rng), (float)TILE_SIZE, sf::Color::White,
+            k == ENTITYKIND::PARTICLE ? lifetime(rng) : ENTITY_FOREVER);
+        if (k != ENTITYKIND::COIN && k != ENTITYKIND::PELLET)
+        {
+            store.vx[id] = velocity(rng);
+            store.vy[id] = velocity(rng);
+        }
+    };
+    for (int i = 0; i < count; i++) spawn(static_cast<ENTITYKIND>(i % ENTITYKIND_LEN));
+
+    sf::Transform fit;
+    fit.scale(sf::Vector2f(1280 / worldSize, 720 / worldSize));
+    sf::FloatRect everything(sf::Vector2f(-worldSize, -worldSize), sf::Vector2f(3 * worldSize, 3 * worldSize));
+    double updateMs = 0, batchMs = 0, drawMs = 0;
+    std::size_t respawned = 0;
+    for (int f = 0; f < frames; f++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        store.Step(dt);
+        std::size_t died = store.RemoveDead();
+        for (std::size_t i = 0; i < died; i++) spawn(ENTITYKIND::PARTICLE);
+        respawned += died;
+        updateMs += msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        store.BuildVertices(everything);
+        batchMs += msSince(start);
+
+        start = std::chrono::steady_clock::now();
+        target.clear();
+        store.Draw(target, fit);
+        target.display();
+        drawMs += msSince(start);
+    }
+    std::cout << "bench-entities: " << count << " entities, " << frames << " frames, " << respawned << " particles replaced\n"
+        << "  update " << updateMs / frames << " ms/frame (" << updateMs * 1e6 / frames / count << " ns/entity)\n"
+        << "  batch  " << batchMs / frames << " ms/frame (" << store.batchedCount() << " quads)\n"
+        << "  draw   " << drawMs / frames << " ms/frame (1 draw call)\n";
+    return 0;
+}
+
+// Runs op over a whole TileBlock, rows are written back by the workers where the op allows
+BulkResult RunBulkOnBlock(TileBlock& block, const BulkOp& op)
+{
+    return RunBulkOp(op, { 0, 0, block.rows, block.cols }, block.rows, block.cols, TILETYPE_LEN,
+        [&block](int r, std::uint8_t* out) { std::memcpy(out, block.row(r), block.cols); },
+        [&block](int r, int c0, int n, const std::uint8_t* in) { std::memcpy(block.row(r) + c0, in, n); }, true);
+}
+
+// Prints how many tiles of each type a map file has
+int PrintHistogram(std::string path)
+{
+    TileBlock block = LoadMapBlock(path);
+    BulkResult result = RunBulkOnBlock(block, BulkOp());
+    for (int t = 0; t < TILETYPE_LEN; t++) std::cout << "  " << tileTypeString[t] << ": " << result.histogram[t] << "\n";
+    std::cout << "histogram: " << block.rows << "x" << block.cols << " in " << result.ms << " ms\n";
+    return 0;
+}
+
+// Every tile of type from (or any, "*") that passes mask becomes to, saved to outPath
+int ReplaceTilesInFile(std::string path, std::string outPath, std::string from, std::string to, std::string mask)
+{
+    BulkOp op;
+    op.kind = BULKOP::SET;
+    std::uint8_t type;
+    if (from == "*") op.from = BULK_ANY;
+    else if (parseTileType(from, type)) op.from = type;
+    else throw std::runtime_error("Error: unknown tile type '" + from + "'");
+    if (!parseTileType(to, op.to)) throw std::runtime_error("Error: unknown tile type '" + to + "'");
+    if (!parseBulkMask(mask, op.mask)) throw std::runtime_error("Error: unknown mask '" + mask + "'");
+
+    TileBlock block = LoadMapBlock(path);
+    BulkResult result = RunBulkOnBlock(block, op);
+    std::cout << "replace: " << result.changed << " tiles in " << result.rowsWritten << " rows changed in " << result.ms << " ms\n";
+    SaveMapBlock(block, outPath);
+    return 0;
+}
+
+// Times every bulk operation on a generated rows x cols map held in memory (no files),
+// against a plain single threaded loop for the histogram
+int BenchBulk(int rows, int cols)
+{
+    if ((long long)rows * cols > (1LL << 31)) throw std::runtime_error("Error: at most 2^31 tiles");
+    TileBlock block;
+    block.Create(rows, cols);
+    auto start = std::chrono::steady_clock::now();
+    parallelFor(rows, [&](int r0, int r1)
+    {
+        for (int r = r0; r < r1; r++)
+        {
+            std::uint8_t* row = block.row(r);
+            for (int c = 0; c < cols; c++)
+            {
+                std::uint64_t x = mazeMix((std::uint64_t)r * cols + c) % 20;
+                row[c] = (std::uint8_t)(x < 6 ? TILETYPE::WALL : x < 9 ? TILETYPE::COIN : x == 9 ? TILETYPE::GHOSTSPAWN : TILETYPE::BLANK);
+            }
+        }
+    });
+    std::cout << "bench-bulk: " << rows << "x" << cols << " map generated in " << msSince(start) << " ms, " << workerCount() << " threads\n";
+
+    start = std::chrono::steady_clock::now();
+    std::vector<std::uint64_t> plain(256, 0);
+    for (std::uint8_t t : block.tiles) plain[t]++;
+    double plainMs = msSince(start);
+
+    BulkResult histogram = RunBulkOnBlock(block, BulkOp());
+    bool same = true;
+    for (int t = 0; t < TILETYPE_LEN; t++) same = same && histogram.histogram[t] == plain[t];
+    std::cout << "  histogram          " << histogram.ms << " ms (plain loop " << plainMs << " ms)\n";
+
+    auto timeSet = [&](const char* name, int from, TILETYPE to, BulkMask mask)
+    {
+        BulkOp op;
+        op.kind = BULKOP::SET;
+        op.from = from;
+        op.to = (std::uint8_t)to;
+        op.mask = mask;
+        BulkResult result = RunBulkOnBlock(block, op);
+        std::cout << "  " << name << result.ms << " ms (" << result.changed << " tiles)\n";
+    };
+    timeSet("coin -> blank      ", (int)TILETYPE::COIN, TILETYPE::BLANK, BulkMask());
+    timeSet("border wall->blank ", (int)TILETYPE::WALL, TILETYPE::BLANK, { BULKMASK::BORDER, 0 });
+    timeSet("wall by ghost->coin", (int)TILETYPE::WALL, TILETYPE::COIN, { BULKMASK::TOUCHING, (std::uint8_t)TILETYPE::GHOSTSPAWN });
+    if (!same)
+    {
+        std::cerr << "bench-bulk: histogram differs from the plain loop\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Command line tools, these run without opening a window
+int RunCommandLine(std::vector<std::string> args)
+{
+    try
+    {
+        if (args[0] == "--diff" && args.size() == 4)
+        {
+            TileBlock from = LoadMapBlock(args[1]);
+            TileBlock to = LoadMapBlock(args[2]);
+            auto start = std::chrono::steady_clock::now();
+            MapPatch patch = DiffMaps(from, to);
+            double ms = msSince(start);
+            SavePatch(patch, args[3]);
+            std::cout << "diff: " << patch.rects.size() << " rects, " << patch.changedTiles() << " tiles in " << ms << " ms\n";
+            return 0;
+        }
+        if (args[0] == "--patch" && args.size() == 4)
+        {
+            TileBlock base = LoadMapBlock(args[1]);
+            MapPatch patch = LoadPatch(args[2]);
+            auto start = std::chrono::steady_clock::now();
+            TileBlock result = ApplyPatch(base, patch);
+            std::cout << "patch: applied " << patch.rects.size() << " rects in " << msSince(start) << " ms\n";
+            SaveMapBlock(result, args[3]);
+            return 0;
+        }
+        if (args[0] == "--merge" && args.size() == 5)
+        {
+            TileBlock base = LoadMapBlock(args[1]);
+            TileBlock ours = LoadMapBlock(args[2]);
+            TileBlock theirs = LoadMapBlock(args[3]);
+            auto start = std::chrono::steady_clock::now();
+            MergeResult result = MergeMaps(base, ours, theirs);
+            std::cout << "merge: done in " << msSince(start) << " ms\n";
+            if (!result.conflicts.empty())
+            {
+                std::cerr << "merge: " << result.conflicts.size() << " conflicting tiles, first at row "
+                    << result.conflicts[0][0] << " col " << result.conflicts[0][1] << ". Nothing written.\n";
+                return 1;
+            }
+            SaveMapBlock(result.merged, args[4]);
+            return 0;
+        }
+        if (args[0] == "--export" && (args.size() == 3 || args.size() == 4))
+        {
+            int pixelsPerTile = 1;
+            if (args.size() == 4 && (!parseNumber(args[3], pixelsPerTile) || pixelsPerTile < 1)) throw std::runtime_error("Error: pixels per tile must be >= 1");
+            return ExportMapImage(args[1], args[2], pixelsPerTile, 0);
+        }
+        if (args[0] == "--thumbnail" && args.size() == 4)
+        {
+            int maxSize;
+            if (!parseNumber(args[3], maxSize) || maxSize < 1) throw std::runtime_error("Error: thumbnail size must be >= 1");
+            return ExportMapImage(args[1], args[2], 1, maxSize);
+        }
+        if (args[0] == "--generate" && (args.size() == 4 || args.size() == 5))
+        {
+            int rows, cols;
+            if (!parseNumber(args[2], rows) || !parseNumber(args[3], cols)) throw std::runtime_error("Error: rows and cols must be numbers");
+            std::uint64_t seed = args.size() == 5 ? std::stoull(args[4]) : 1;
+            return GenerateMapFile(args[1], rows, cols, seed);
+        }
+        if (args[0] == "--validate" && args.size() == 2) return ValidateMapFile(args[1]);
+        if (args[0] == "--catalogue" && (args.size() == 2 || args.size() == 3)) return ListMapCatalogue(args[1], args.size() == 3 ? args[2] : "");
+        if (args[0] == "--server" && (args.size() == 2 || args.size() == 3 || args.size() == 4))
+        {
+            int port = DEFAULT_SERVER_PORT, rate = 30;
+            if (args.size() >= 3 && (!parseNumber(args[2], port) || port < 0 || port > 65535)) throw std::runtime_error("Error: bad port");
+            if (args.size() == 4 && (!parseNumber(args[3], rate) || rate < 1)) throw std::runtime_error("Error: ticks per second must be >= 1");
+            return RunGameServer(args[1], (std::uint16_t)port, (std::uint32_t)rate);
+        }
+        if (args[0] == "--client" && args.size() <= 3)
+        {
+            int port = DEFAULT_SERVER_PORT, ticks = 300;
+            if (args.size() >= 2 && (!parseNumber(args[1], port) || port < 1 || port > 65535)) throw std::runtime_error("Error: bad port");
+            if (args.size() == 3 && (!parseNumber(args[2], ticks) || ticks < 1)) throw std::runtime_error("Error: ticks must be >= 1");
+            return RunBotClient((std::uint16_t)port, ticks);
+        }
+        if (args[0] == "--loopback-test" && (args.size() >= 2 && args.size() <= 4))
+        {
+            int clients = 8, ticks = 600;
+            if (args.size() >= 3 && (!parseNumber(args[2], clients) || clients < 1)) throw std::runtime_error("Error: clients must be >= 1");
+            if (args.size() == 4 && (!parseNumber(args[3], ticks) || ticks < 1)) throw std::runtime_error("Error: ticks must be >= 1");
+            return RunLoopbackTest(args[1], clients, ticks);
+        }
+        if (args[0] == "--transform" && args.size() == 4)
+        {
+            MAPTRANSFORM t;
+            if (!parseTransform(args[3], t)) throw std::runtime_error("Error: unknown transform '" + args[3] + "'");
+            TileBlock base = LoadMapBlock(args[1]);
+            auto start = std::chrono::steady_clock::now();
+            TileBlock result = TransformBlock(base, t);
+            std::cout << "transform: " << mapTransformString[(int)t] << " of " << base.rows << "x" << base.cols << " in " << msSince(start) << " ms\n";
+            SaveMapBlock(result, args[2]);
+            return 0;
+        }
+        if (args[0] == "--bench-path" && (args.size() == 2 || args.size() == 3))
+        {
+            int queries = 1000;
+            if (args.size() == 3 && (!parseNumber(args[2], queries) || queries < 1)) throw std::runtime_error("Error: query count must be >= 1");
+            return BenchPath(args[1], queries);
+        }
+        if (args[0] == "--bench-layout" && (args.size() == 2 || args.size() == 3))
+        {
+            int lookups = 10000000;
+            if (args.size() == 3 && (!parseNumber(args[2], lookups) || lookups < 1)) throw std::runtime_error("Error: lookup count must be >= 1");
+            return BenchLayout(args[1], lookups);
+        }
+        if (args[0] == "--bench-entities" && (args.size() == 2 || args.size() == 3))
+        {
+            int count = 0, frames = 300;
+            if (!parseNumber(args[1], count) || count < 1) throw std::runtime_error("Error: entity count must be >= 1");
+            if (args.size() == 3 && (!parseNumber(args[2], frames) || frames < 1)) throw std::runtime_error("Error: frame count must be >= 1");
+            return BenchEntities(count, frames);
+        }
+        if (args[0] == "--histogram" && args.size() == 2) return PrintHistogram(args[1]);
+        if (args[0] == "--replace" && (args.size() == 5 || args.size() == 6))
+            return ReplaceTilesInFile(args[1], args[2], args[3], args[4], args.size() == 6 ? args[5] : "all");
+        if (args[0] == "--bench-bulk" && args.size() == 3)
+        {
+            int rows, cols;
+            if (!parseNumber(args[1], rows) || !parseNumber(args[2], cols) || rows < 1 || cols < 1) throw std::runtime_error("Error: rows and cols must be numbers >= 1");
+            return BenchBulk(rows, cols);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    std::cout << "Usage:\n"
+        << "  MapMaker --diff <old map> <new map> <out.mpatch>\n"
+        << "  MapMaker --patch <base map> <patch.mpatch> <out map>\n"
+        << "  MapMaker --merge <base map> <ours> <theirs> <out map>\n"
+        << "  MapMaker --export <map> <out.png> [pixels per tile, default 1]\n"
+        << "  MapMaker --thumbnail <map> <out.png> <max size in pixels>\n"
+        << "  MapMaker --bench-path <map> [queries, default 1000]\n"
+        << "  MapMaker --bench-layout <map> [random lookups, default 10000000]\n"
+        << "  MapMaker --bench-entities <count> [frames, default 300]\n"
+        << "  MapMaker --histogram <map>\n"
+        << "  MapMaker --replace <map> <out map> <from type|*> <to type> [all|border|interior|touching:<type>|not-touching:<type>]\n"
+        << "  MapMaker --bench-bulk <rows> <cols>\n"
+        << "  MapMaker --generate <out map> <rows> <cols> [seed, default 1]\n"
+        << "  MapMaker --validate <map>\n"
+        << "  MapMaker --catalogue <directory> [filter, ex. \"maze rows>=100 ghosts>0\"]\n"
+        << "  MapMaker --server <map> [port, default 7777] [ticks per second, default 30]\n"
+        << "  MapMaker --client [port, default 7777] [ticks, default 300]\n"
+        << "  MapMaker --loopback-test <map> [clients, default 8] [ticks, default 600]\n"
+        << "  MapMaker --transform <map> <out map> <flip_h|flip_v|rotate_cw|rotate_ccw|rotate_180|transpose>\n";
+    return 2;
+}
+
+// Benchmark run of the editor itself (--bench-frames): runs a fixed number of frames
+// panning the camera across the map, then exits. With an allocation budget the run
+// fails (exit code 1) if any frame after warm-up allocates more than that.
+struct BenchRun
+{
+    int frames = 0;
+    long long allocBudget = -1;
+    std::string allocCsv;
+    std::string mapPath = "example.csv";
+};
+
+// --bench-frames <frames> [--map <path>] [--alloc-budget <allocs per frame>] [--alloc-csv <out.csv>]
+bool ParseBenchRun(const std::vector<std::string>& args, BenchRun& bench)
+{
+    if (args.size() < 2 || args[0] != "--bench-frames" || !parseNumber(args[1], bench.frames) || bench.frames < 1) return false;
+    for (std::size_t i = 2; i + 1 < args.size(); i += 2)
+    {
+        int budget;
+        if (args[i] == "--map") bench.mapPath = args[i + 1];
+        else if (args[i] == "--alloc-csv") bench.allocCsv = args[i + 1];
+        else if (args[i] == "--alloc-budget" && parseNumber(args[i + 1], budget) && budget >= 0) bench.allocBudget = budget;
+        else return false;
+    }
+    return args.size() % 2 == 0;
+}
+
+int main(int argc, char** argv)
+{
+    BenchRun bench;
+    if (argc > 1)
+    {
+        std::vector<std::string> args(argv + 1, argv + argc);
+        if (args[0] != "--bench-frames") return RunCommandLine(args);
+        if (!ParseBenchRun(args, bench))
+        {
+            std::cout << "Usage: MapMaker --bench-frames <frames> [--map <path>] [--alloc-budget <allocs per frame>] [--alloc-csv <out.csv>]\n";
+            return 2;
+        }
+        if (bench.allocBudget >= 0 && !AllocTracker::isEnabled())
+        {
+            std::cerr << "bench: --alloc-budget needs a build with TRACK_ALLOCATIONS defined\n";
+            return 2;
+        }
+        allocTracker.budgetPerFrame = bench.allocBudget;
+    }
+
     _map.screenPos = sf::Vector2f(0, 0);
     //_map.CreateBlank(20, 20);
-    _map.LoadFromFile("example.csv");
+    _map.LoadFromFile(bench.frames > 0 ? bench.mapPath : "example.csv");
+    // Benchmark runs leave the journal alone
+    if (bench.frames == 0) _map.StartAutosave(true);
     int screenWidth = 1024;
     int screenHeight = 720;
     window = new sf::RenderWindow(sf::VideoMode({ (unsigned)screenWidth, (unsigned)screenHeight }), "Pacman Maze Editor");
     menu.Init(window, screenWidth, screenHeight);
     LoadTextures();
     textDraw.Init(*window);
+    if (bench.frames > 0) GLOBAL_input.cameraMovAxis = sf::Vector2f(1, 1);
+    auto benchStart = std::chrono::steady_clock::now();
+    allocTracker.Start();
+    int frame = 0;
     while (window->isOpen())
     {
+        if (bench.frames > 0 && frame++ == bench.frames) break;
         float dt = game_clock.restart().asSeconds();
         //GLOBAL_input.mouseScoll = 0;
         while (std::optional event = window->pollEvent())
         {
             if (event->is<sf::Event::Closed>())window->close();
+            else if (const auto* resized = event->getIf<sf::Event::Resized>()) OnResized(resized->size);
             HandleInput(event, dt);
         }
         Update(dt);
@@ -963,7 +3085,40 @@ int main()
         Draw();
 
         window->display();
+        allocTracker.EndFrame();
+    }
+
+    if (bench.frames > 0)
+    {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - benchStart).count();
+        std::cout << "bench: " << bench.frames << " frames, " << ms / bench.frames << " ms/frame\n";
+        if (AllocTracker::isEnabled())
+        {
+            std::cout << "bench: worst frame " << allocTracker.worstFrame.frame << " with " << allocTracker.worstFrame.allocs << " allocations ("
+                << allocTracker.worstFrame.bytes << " bytes)\n";
+            if (!bench.allocCsv.empty() && !allocTracker.ExportCsv(bench.allocCsv)) std::cerr << "bench: could not write '" << bench.allocCsv << "'\n";
+        }
+        window->close();
+        _map.pager.Close();
+        if (allocTracker.framesOverBudget > 0)
+        {
+            std::cerr << "bench: " << allocTracker.framesOverBudget << " frames over the budget of " << bench.allocBudget << " allocations\n";
+            return 1;
+        }
+        return 0;
+    }
+    // Unsaved edits come back next time only if the user wants to keep them, otherwise
+    // the journal goes. Then wait for the last journal writes, and write back any dirty chunks.
+    if (_map.journal.isRunning())
+    {
+        bool keep = _map.hasUnsavedEdits() && AskYesNo("Unsaved changes",
+            "Keep the unsaved changes to " + (_map.filePath.empty() ? std::string("the untitled map") : "'" + _map.filePath + "'")
+            + " for the next time it is opened?");
+        if (keep) _map.AutosaveTick(0, true);
+        _map.journal.Stop(!keep);
     }
+    _map.journal.Shutdown();
+    _map.pager.Close();
 
 
     return 0;
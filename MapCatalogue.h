@@ -0,0 +1,510 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+#include "MapExport.h"
+#include "MapPager.h"
+#include "ParallelFor.h"
+#include "TileBlock.h"
+#include "TileTypeDefinitions.h"
+
+// Catalogue of every map in a directory, for browsing without opening them.
+//
+// Each map gets one entry: size, tile type histogram, spawn positions, a tiny thumbnail
+// (one tile type per pixel) and a content hash. Entries are kept in a sidecar file in the
+// directory (CATALOGUE_FILE). A scan only re-indexes files whose size or modification
+// time changed since the sidecar was written, spread over worker threads, and drops
+// entries of deleted files.
+//
+// .csv maps are read here with the rules of Map::LoadFromFile (but no Map), .pmap maps are
+// streamed row by row through a MapPager with a small cache.
+
+const char* const CATALOGUE_FILE = ".mapcatalogue";
+const std::uint32_t CATALOGUE_MAGIC = 0x5441434Du; // "MCAT"
+const std::uint32_t CATALOGUE_VERSION = 2;
+// Thumbnails fit in this many pixels square
+const int CATALOGUE_THUMBNAIL = 32;
+// Spawns stored per type
+const int CATALOGUE_MAX_SPAWNS = 16;
+// Page cache of each .pmap being indexed
+const std::size_t CATALOGUE_PAGER_BUDGET = 16u * 1024 * 1024;
+
+struct CatalogueEntry
+{
+    // File name inside the directory
+    std::string name;
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+    // False if the file could not be read (error says why)
+    bool ok = false;
+    std::string error;
+
+    int rows = 0, cols = 0;
+    std::array<std::uint64_t, TILETYPE_LEN> histogram = {};
+    // {row, col}, the first CATALOGUE_MAX_SPAWNS of each
+    std::vector<std::array<int, 2>> playerSpawns;
+    std::vector<std::array<int, 2>> ghostSpawns;
+    // Tile type of every thumbnail pixel, thumbWidth x thumbHeight
+    int thumbWidth = 0, thumbHeight = 0;
+    std::vector<std::uint8_t> thumbnail;
+    // FNV-1a of the size and every tile
+    std::uint64_t hash = 0;
+};
+
+struct CatalogueScanStats
+{
+    int files = 0;
+    int indexed = 0;
+    int reused = 0;
+    int failed = 0;
+    int removed = 0;
+    double ms = 0;
+};
+
+// Fills in the metadata of entry from the map's rows
+inline void IndexMapRows(int rows, int cols, const MapRowReader& readRow, CatalogueEntry& entry)
+{
+    entry.rows = rows;
+    entry.cols = cols;
+    entry.histogram.fill(0);
+    entry.playerSpawns.clear();
+    entry.ghostSpawns.clear();
+    int step = std::max(1, (std::max(rows, cols) + CATALOGUE_THUMBNAIL - 1) / CATALOGUE_THUMBNAIL);
+    entry.thumbWidth = (cols + step - 1) / step;
+    entry.thumbHeight = (rows + step - 1) / step;
+    entry.thumbnail.assign((std::size_t)entry.thumbWidth * entry.thumbHeight, 0);
+
+    std::uint64_t h = 1469598103934665603ull;
+    auto mix = [&h](std::uint64_t v) { h = (h ^ v) * 1099511628211ull; };
+    mix((std::uint64_t)rows);
+    mix((std::uint64_t)cols);
+    std::vector<std::uint8_t> row(cols);
+    for (int r = 0; r < rows; r++)
+    {
+        readRow(r, row.data());
+        for (int c = 0; c < cols; c++)
+        {
+            std::uint8_t t = row[c];
+            mix(t);
+            if (t < TILETYPE_LEN) entry.histogram[t]++;
+            if (t == (std::uint8_t)TILETYPE::PLAYERSPAWN && entry.playerSpawns.size() < CATALOGUE_MAX_SPAWNS) entry.playerSpawns.push_back({ r, c });
+            if (t == (std::uint8_t)TILETYPE::GHOSTSPAWN && entry.ghostSpawns.size() < CATALOGUE_MAX_SPAWNS) entry.ghostSpawns.push_back({ r, c });
+        }
+        // Top left tile of every step x step cell
+        if (r % step == 0)
+        {
+            std::uint8_t* thumb = &entry.thumbnail[(std::size_t)(r / step) * entry.thumbWidth];
+            for (int x = 0; x < entry.thumbWidth; x++) thumb[x] = row[x * step];
+        }
+    }
+    entry.hash = h;
+}
+
+// Reads the tiles of a map .csv without going through Map, with the rules of Map::LoadFromFile:
+// a "rows,cols" line, then rows lines of cols comma separated tile ids (a header-only file is
+// all blank). Fields are plain non negative numbers, anything else makes the map unreadable.
+inline bool ReadCsvTiles(const std::string& path, TileBlock& out, std::string& error)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        error = "could not open";
+        return false;
+    }
+    std::vector<char> data((std::size_t)file.tellg());
+    file.seekg(0);
+    file.read(data.data(), data.size());
+    const char* p = data.data();
+    const char* end = p + data.size();
+
+    // One line, without its line break (and \r). False past the last line.
+    const char* lineEnd = nullptr;
+    auto nextLine = [&p, &lineEnd, end]() -> bool
+    {
+        if (lineEnd) p = lineEnd < end ? lineEnd + 1 : end;
+        if (p == end) return false;
+        lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!lineEnd) lineEnd = end;
+        return true;
+    };
+    // Next field of the current line, false if it is not a number
+    auto nextField = [&p, &lineEnd](long long& v) -> bool
+    {
+        const char* stop = lineEnd > p && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+        while (p < stop && (*p == ' ' || *p == '\t')) p++;
+        if (p == stop || !std::isdigit((unsigned char)*p)) return false;
+        v = 0;
+        while (p < stop && std::isdigit((unsigned char)*p) && v < (1ll << 40)) v = v * 10 + (*p++ - '0');
+        while (p < stop && (*p == ' ' || *p == '\t')) p++;
+        if (p < stop && *p == ',') p++;
+        else if (p != stop) return false;
+        return true;
+    };
+    auto atLineEnd = [&p, &lineEnd]() { return p == lineEnd || (p + 1 == lineEnd && *p == '\r'); };
+
+    long long rows, cols;
+    if (!nextLine() || !nextField(rows) || !nextField(cols) || !atLineEnd() || rows <= 0 || cols <= 0 || rows * cols > (1ll << 31))
+    {
+        error = "bad header";
+        return false;
+    }
+    out.Create((int)rows, (int)cols);
+    if (!nextLine()) return true; // header only, all blank
+    for (int r = 0; r < rows; r++)
+    {
+        if (r > 0 && !nextLine())
+        {
+            error = "fewer rows than the header says";
+            return false;
+        }
+        std::uint8_t* row = out.row(r);
+        for (int c = 0; c < cols; c++)
+        {
+            long long v;
+            if (atLineEnd())
+            {
+                error = "row " + std::to_string(r) + " has fewer columns than the header says";
+                return false;
+            }
+            if (!nextField(v))
+            {
+                error = "row " + std::to_string(r) + ": not a tile id";
+                return false;
+            }
+            if (v >= TILETYPE_LEN)
+            {
+                error = "unknown tile id " + std::to_string(v);
+                return false;
+            }
+            row[c] = (std::uint8_t)v;
+        }
+        if (!atLineEnd())
+        {
+            error = "row " + std::to_string(r) + " has more columns than the header says";
+            return false;
+        }
+    }
+    if (nextLine())
+    {
+        error = "more rows than the header says";
+        return false;
+    }
+    return true;
+}
+
+// Reads and indexes the map at path (.csv or .pmap), false with entry.error set if it can't
+inline bool IndexMapFile(const std::string& path, CatalogueEntry& entry)
+{
+    std::size_t dot = path.rfind('.');
+    std::string ext = dot == std::string::npos ? "" : path.substr(dot);
+    if (ext == ".csv")
+    {
+        TileBlock tiles;
+        if (!ReadCsvTiles(path, tiles, entry.error)) return false;
+        IndexMapRows(tiles.rows, tiles.cols, [&tiles](int r, std::uint8_t* out) { std::memcpy(out, tiles.row(r), tiles.cols); }, entry);
+        return true;
+    }
+    if (ext == ".pmap")
+    {
+        try
+        {
+            MapPager pager;
+            pager.memoryBudget = CATALOGUE_PAGER_BUDGET;
+            if (!pager.Open(path))
+            {
+                entry.error = "could not open";
+                return false;
+            }
+            IndexMapRows(pager.rows, pager.cols, [&pager](int r, std::uint8_t* out) { pager.readRow(r, 0, pager.cols, out); }, entry);
+            return true;
+        }
+        catch (const std::exception& ex)
+        {
+            entry.error = ex.what();
+            return false;
+        }
+    }
+    entry.error = "not a map file";
+    return false;
+}
+
+// Space separated terms that must all match. A word matches names containing it (any
+// case), key<op>number compares a count: rows, cols, walls, coins, ghosts, players.
+// Ops are < <= = >= >.
+class CatalogueFilter
+{
+private:
+    struct Compare
+    {
+        std::string key;
+        std::string op;
+        long long value;
+    };
+    std::vector<std::string> words;
+    std::vector<Compare> compares;
+
+    static std::string lower(std::string s)
+    {
+        for (char& ch : s) ch = (char)std::tolower((unsigned char)ch);
+        return s;
+    }
+
+    static long long field(const CatalogueEntry& e, const std::string& key)
+    {
+        if (key == "rows") return e.rows;
+        if (key == "cols") return e.cols;
+        if (key == "walls") return (long long)e.histogram[(int)TILETYPE::WALL];
+        if (key == "coins") return (long long)e.histogram[(int)TILETYPE::COIN];
+        if (key == "ghosts") return (long long)e.histogram[(int)TILETYPE::GHOSTSPAWN];
+        if (key == "players") return (long long)e.histogram[(int)TILETYPE::PLAYERSPAWN];
+        return -1;
+    }
+
+public:
+    explicit CatalogueFilter(const std::string& text = "")
+    {
+        std::size_t i = 0;
+        while (i < text.size())
+        {
+            while (i < text.size() && text[i] == ' ') i++;
+            std::size_t j = text.find(' ', i);
+            if (j == std::string::npos) j = text.size();
+            std::string term = lower(text.substr(i, j - i));
+            i = j;
+            if (term.empty()) continue;
+
+            std::size_t opAt = term.find_first_of("<=>");
+            std::size_t valueAt = term.find_first_not_of("<=>", opAt);
+            if (opAt != std::string::npos && opAt > 0 && valueAt != std::string::npos
+                && std::all_of(term.begin() + valueAt, term.end(), [](char ch) { return std::isdigit((unsigned char)ch); }))
+            {
+                compares.push_back({ term.substr(0, opAt), term.substr(opAt, valueAt - opAt), std::stoll(term.substr(valueAt)) });
+            }
+            else words.push_back(term);
+        }
+    }
+
+    bool matches(const CatalogueEntry& e) const
+    {
+        if (!words.empty())
+        {
+            std::string name = lower(e.name);
+            for (const std::string& w : words)
+            {
+                if (name.find(w) == std::string::npos) return false;
+            }
+        }
+        for (const Compare& c : compares)
+        {
+            long long v = field(e, c.key);
+            bool ok = c.op == "<" ? v < c.value : c.op == "<=" ? v <= c.value : c.op == "=" ? v == c.value
+                : c.op == ">=" ? v >= c.value : c.op == ">" ? v > c.value : false;
+            if (!ok || !e.ok) return false;
+        }
+        return true;
+    }
+};
+
+class MapCatalogue
+{
+private:
+    template <class T> static void put(std::ofstream& out, T v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    template <class T> static T get(std::ifstream& in)
+    {
+        T v{};
+        in.read(reinterpret_cast<char*>(&v), sizeof(v));
+        return v;
+    }
+    static void putString(std::ofstream& out, const std::string& s)
+    {
+        put<std::uint16_t>(out, (std::uint16_t)s.size());
+        out.write(s.data(), s.size());
+    }
+    static std::string getString(std::ifstream& in)
+    {
+        std::string s(get<std::uint16_t>(in), '\0');
+        in.read(&s[0], s.size());
+        return s;
+    }
+    static void putPoints(std::ofstream& out, const std::vector<std::array<int, 2>>& points)
+    {
+        put<std::uint16_t>(out, (std::uint16_t)points.size());
+        for (const std::array<int, 2>& p : points)
+        {
+            put<std::int32_t>(out, p[0]);
+            put<std::int32_t>(out, p[1]);
+        }
+    }
+    static std::vector<std::array<int, 2>> getPoints(std::ifstream& in)
+    {
+        std::vector<std::array<int, 2>> points(std::min<std::uint16_t>(get<std::uint16_t>(in), CATALOGUE_MAX_SPAWNS));
+        for (std::array<int, 2>& p : points)
+        {
+            p[0] = get<std::int32_t>(in);
+            p[1] = get<std::int32_t>(in);
+        }
+        return points;
+    }
+
+    static std::int64_t fileTime(const std::filesystem::path& path, std::error_code& ec)
+    {
+        return (std::int64_t)std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    }
+
+public:
+    std::string directory;
+    // Sorted by name
+    std::vector<CatalogueEntry> entries;
+    CatalogueScanStats lastScan;
+
+    std::string sidecarPath() const { return (std::filesystem::path(directory) / CATALOGUE_FILE).string(); }
+
+    // Reads the sidecar of directory, false (and no entries) if there is none or it is unreadable
+    bool Load(const std::string& dir)
+    {
+        directory = dir;
+        entries.clear();
+        std::ifstream in(sidecarPath(), std::ios::binary);
+        if (!in || get<std::uint32_t>(in) != CATALOGUE_MAGIC || get<std::uint32_t>(in) != CATALOGUE_VERSION) return false;
+        std::uint32_t count = get<std::uint32_t>(in);
+        for (std::uint32_t i = 0; i < count && in; i++)
+        {
+            CatalogueEntry e;
+            e.name = getString(in);
+            e.size = get<std::uint64_t>(in);
+            e.mtime = get<std::int64_t>(in);
+            e.ok = get<std::uint8_t>(in) != 0;
+            e.error = getString(in);
+            e.rows = get<std::int32_t>(in);
+            e.cols = get<std::int32_t>(in);
+            for (std::uint64_t& n : e.histogram) n = get<std::uint64_t>(in);
+            e.playerSpawns = getPoints(in);
+            e.ghostSpawns = getPoints(in);
+            e.thumbWidth = get<std::uint16_t>(in);
+            e.thumbHeight = get<std::uint16_t>(in);
+            if (e.thumbWidth > CATALOGUE_THUMBNAIL || e.thumbHeight > CATALOGUE_THUMBNAIL) break;
+            e.thumbnail.resize((std::size_t)e.thumbWidth * e.thumbHeight);
+            in.read(reinterpret_cast<char*>(e.thumbnail.data()), e.thumbnail.size());
+            e.hash = get<std::uint64_t>(in);
+            if (in) entries.push_back(std::move(e));
+        }
+        if (!in || entries.size() != count)
+        {
+            entries.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // Writes the sidecar through a temp file
+    bool Save() const
+    {
+        std::string path = sidecarPath();
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            put<std::uint32_t>(out, CATALOGUE_MAGIC);
+            put<std::uint32_t>(out, CATALOGUE_VERSION);
+            put<std::uint32_t>(out, (std::uint32_t)entries.size());
+            for (const CatalogueEntry& e : entries)
+            {
+                putString(out, e.name);
+                put<std::uint64_t>(out, e.size);
+                put<std::int64_t>(out, e.mtime);
+                put<std::uint8_t>(out, e.ok ? 1 : 0);
+                putString(out, e.error);
+                put<std::int32_t>(out, e.rows);
+                put<std::int32_t>(out, e.cols);
+                for (std::uint64_t n : e.histogram) put<std::uint64_t>(out, n);
+                putPoints(out, e.playerSpawns);
+                putPoints(out, e.ghostSpawns);
+                put<std::uint16_t>(out, (std::uint16_t)e.thumbWidth);
+                put<std::uint16_t>(out, (std::uint16_t)e.thumbHeight);
+                out.write(reinterpret_cast<const char*>(e.thumbnail.data()), e.thumbnail.size());
+                put<std::uint64_t>(out, e.hash);
+            }
+            if (!out) return false;
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmpPath, path, ec);
+        return !ec;
+    }
+
+    // Brings the catalogue of dir up to date, re-indexing only new and changed files
+    CatalogueScanStats Scan(const std::string& dir, int threads = 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+        CatalogueScanStats stats;
+        if (dir != directory || entries.empty()) Load(dir);
+        std::unordered_map<std::string, std::size_t> known;
+        for (std::size_t i = 0; i < entries.size(); i++) known[entries[i].name] = i;
+
+        std::vector<CatalogueEntry> current;
+        std::vector<std::size_t> stale;
+        int changed = 0;
+        std::error_code ec;
+        for (const std::filesystem::directory_entry& file : std::filesystem::directory_iterator(dir, ec))
+        {
+            std::string ext = file.path().extension().string();
+            if (!file.is_regular_file(ec) || (ext != ".csv" && ext != ".pmap")) continue;
+            CatalogueEntry e;
+            e.name = file.path().filename().string();
+            e.size = (std::uint64_t)file.file_size(ec);
+            e.mtime = fileTime(file.path(), ec);
+            auto it = known.find(e.name);
+            if (it != known.end() && entries[it->second].size == e.size && entries[it->second].mtime == e.mtime)
+            {
+                current.push_back(std::move(entries[it->second]));
+                stats.reused++;
+            }
+            else
+            {
+                changed += it != known.end();
+                stale.push_back(current.size());
+                current.push_back(std::move(e));
+            }
+        }
+        stats.files = (int)current.size();
+        stats.removed = (int)entries.size() - stats.reused - changed;
+
+        // Changed and new files
+        parallelFor((int)stale.size(), [&](int begin, int end)
+        {
+            for (int k = begin; k < end; k++)
+            {
+                CatalogueEntry& e = current[stale[k]];
+                e.ok = IndexMapFile((std::filesystem::path(dir) / e.name).string(), e);
+            }
+        }, threads);
+        stats.indexed = (int)stale.size();
+        for (const CatalogueEntry& e : current) stats.failed += !e.ok;
+
+        std::sort(current.begin(), current.end(), [](const CatalogueEntry& a, const CatalogueEntry& b) { return a.name < b.name; });
+        entries = std::move(current);
+        directory = dir;
+        if (stats.indexed > 0 || stats.removed > 0) Save();
+        stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        lastScan = stats;
+        return stats;
+    }
+
+    // Indices of the entries matching filter
+    std::vector<int> Find(const CatalogueFilter& filter) const
+    {
+        std::vector<int> found;
+        for (int i = 0; i < (int)entries.size(); i++)
+        {
+            if (filter.matches(entries[i])) found.push_back(i);
+        }
+        return found;
+    }
+};
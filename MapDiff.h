@@ -0,0 +1,280 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "TileBlock.h"
+
+// Map diff/patch/merge on TileBlocks.
+//
+// A patch is a list of rectangles holding the new tile values. Changed spans of each
+// row are found with word-wide compares (memcmp for unchanged rows), then spans on
+// consecutive rows that overlap are grown into rectangles.
+//
+// .mpatch layout:
+//   "MPAT" | uint32 version | int32 baseRows | int32 baseCols | int32 rows | int32 cols | uint32 rectCount
+//   per rect: int32 row | int32 col | int32 rows | int32 cols | rows * cols tile bytes
+
+const std::uint32_t MPATCH_VERSION = 1;
+// Unchanged tiles allowed inside a span before it is split in two
+const int DIFF_SPAN_GAP = 16;
+
+struct DiffRect
+{
+    int row = 0, col = 0, rows = 0, cols = 0;
+    // New tile values, rows * cols, row major
+    std::vector<std::uint8_t> tiles;
+};
+
+struct MapPatch
+{
+    int baseRows = 0, baseCols = 0;
+    int rows = 0, cols = 0;
+    std::vector<DiffRect> rects;
+
+    std::size_t changedTiles() const
+    {
+        std::size_t n = 0;
+        for (const DiffRect& r : rects) n += (std::size_t)r.rows * r.cols;
+        return n;
+    }
+};
+
+// Index of the first differing byte in [from, n), or n
+inline int firstDifference(const std::uint8_t* a, const std::uint8_t* b, int from, int n)
+{
+    int i = from;
+    // 32 bytes per step, the four xors vectorise
+    for (; i + 32 <= n; i += 32)
+    {
+        std::uint64_t x[4], y[4];
+        std::memcpy(x, a + i, 32);
+        std::memcpy(y, b + i, 32);
+        if (((x[0] ^ y[0]) | (x[1] ^ y[1]) | (x[2] ^ y[2]) | (x[3] ^ y[3])) != 0) break;
+    }
+    for (; i < n; i++)
+    {
+        if (a[i] != b[i]) return i;
+    }
+    return n;
+}
+
+// Index of the first equal run of DIFF_SPAN_GAP bytes in [from, n), or n
+inline int endOfDifference(const std::uint8_t* a, const std::uint8_t* b, int from, int n)
+{
+    int same = 0;
+    for (int i = from; i < n; i++)
+    {
+        if (a[i] == b[i])
+        {
+            if (++same == DIFF_SPAN_GAP) return i - DIFF_SPAN_GAP + 1;
+        }
+        else same = 0;
+    }
+    return n - same;
+}
+
+// Rectangles of `to` that differ from `from`. Maps of different sizes give one
+// rectangle covering all of `to`.
+inline MapPatch DiffMaps(const TileBlock& from, const TileBlock& to)
+{
+    MapPatch patch;
+    patch.baseRows = from.rows;
+    patch.baseCols = from.cols;
+    patch.rows = to.rows;
+    patch.cols = to.cols;
+
+    if (from.rows != to.rows || from.cols != to.cols)
+    {
+        DiffRect all;
+        all.rows = to.rows;
+        all.cols = to.cols;
+        all.tiles = to.tiles;
+        patch.rects.push_back(std::move(all));
+        return patch;
+    }
+
+    // Rects still growing downwards as {col0, col1 (exclusive)} plus their first row
+    struct OpenRect { int row, col0, col1, lastRow; };
+    std::vector<OpenRect> open, next;
+    std::vector<OpenRect> closed;
+    const int n = to.cols;
+
+    for (int r = 0; r < to.rows; r++)
+    {
+        const std::uint8_t* a = from.row(r);
+        const std::uint8_t* b = to.row(r);
+        next.clear();
+        if (std::memcmp(a, b, n) != 0)
+        {
+            int c = firstDifference(a, b, 0, n);
+            while (c < n)
+            {
+                int end = endOfDifference(a, b, c, n);
+                // Grow the first open rect this span touches, or open a new one
+                bool merged = false;
+                for (OpenRect& o : open)
+                {
+                    if (c < o.col1 + DIFF_SPAN_GAP && end + DIFF_SPAN_GAP > o.col0)
+                    {
+                        o.col0 = std::min(o.col0, c);
+                        o.col1 = std::max(o.col1, end);
+                        o.lastRow = r;
+                        merged = true;
+                        break;
+                    }
+                }
+                if (!merged) next.push_back({ r, c, end, r });
+                c = firstDifference(a, b, end, n);
+            }
+        }
+        // Rects that did not reach this row are done
+        for (const OpenRect& o : open)
+        {
+            if (o.lastRow == r) next.push_back(o);
+            else closed.push_back(o);
+        }
+        open.swap(next);
+    }
+    closed.insert(closed.end(), open.begin(), open.end());
+
+    for (const OpenRect& o : closed)
+    {
+        DiffRect rect;
+        rect.row = o.row;
+        rect.col = o.col0;
+        rect.rows = o.lastRow - o.row + 1;
+        rect.cols = o.col1 - o.col0;
+        rect.tiles.resize((std::size_t)rect.rows * rect.cols);
+        for (int i = 0; i < rect.rows; i++)
+        {
+            std::memcpy(&rect.tiles[(std::size_t)i * rect.cols], to.row(rect.row + i) + rect.col, rect.cols);
+        }
+        patch.rects.push_back(std::move(rect));
+    }
+    return patch;
+}
+
+// base + patch, one memcpy per rect row
+inline TileBlock ApplyPatch(const TileBlock& base, const MapPatch& patch)
+{
+    if (base.rows != patch.baseRows || base.cols != patch.baseCols)
+        throw std::runtime_error("Patch error: patch was made against a " + std::to_string(patch.baseRows) + "x" + std::to_string(patch.baseCols) + " map");
+
+    TileBlock result;
+    if (patch.rows == base.rows && patch.cols == base.cols) result = base;
+    else result.Create(patch.rows, patch.cols);
+
+    for (const DiffRect& rect : patch.rects)
+    {
+        if (rect.row < 0 || rect.col < 0 || rect.row + rect.rows > result.rows || rect.col + rect.cols > result.cols)
+            throw std::runtime_error("Patch error: rectangle outside the map");
+        for (int i = 0; i < rect.rows; i++)
+        {
+            std::memcpy(result.row(rect.row + i) + rect.col, &rect.tiles[(std::size_t)i * rect.cols], rect.cols);
+        }
+    }
+    return result;
+}
+
+struct MergeResult
+{
+    TileBlock merged;
+    // {row, col} of tiles both sides changed to different values
+    std::vector<std::array<int, 2>> conflicts;
+};
+
+// Three-way merge: ours is taken as is, then every tile theirs changed is applied
+// unless ours changed the same tile to something else (a conflict).
+inline MergeResult MergeMaps(const TileBlock& base, const TileBlock& ours, const TileBlock& theirs)
+{
+    if (ours.rows != base.rows || ours.cols != base.cols || theirs.rows != base.rows || theirs.cols != base.cols)
+        throw std::runtime_error("Merge error: all three maps must be the same size");
+
+    MergeResult result;
+    result.merged = ours;
+    MapPatch theirPatch = DiffMaps(base, theirs);
+    for (const DiffRect& rect : theirPatch.rects)
+    {
+        for (int i = 0; i < rect.rows; i++)
+        {
+            int r = rect.row + i;
+            const std::uint8_t* b = base.row(r) + rect.col;
+            const std::uint8_t* o = ours.row(r) + rect.col;
+            const std::uint8_t* t = &rect.tiles[(std::size_t)i * rect.cols];
+            std::uint8_t* m = result.merged.row(r) + rect.col;
+            for (int j = 0; j < rect.cols; j++)
+            {
+                if (t[j] == b[j]) continue;
+                if (o[j] != b[j] && o[j] != t[j]) result.conflicts.push_back({ r, rect.col + j });
+                else m[j] = t[j];
+            }
+        }
+    }
+    return result;
+}
+
+inline void SavePatch(const MapPatch& patch, const std::string& path)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Error: could not write patch '" + path + "'");
+    std::int32_t header[4] = { patch.baseRows, patch.baseCols, patch.rows, patch.cols };
+    std::uint32_t count = (std::uint32_t)patch.rects.size();
+    out.write("MPAT", 4);
+    out.write(reinterpret_cast<const char*>(&MPATCH_VERSION), sizeof(MPATCH_VERSION));
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const DiffRect& rect : patch.rects)
+    {
+        std::int32_t r[4] = { rect.row, rect.col, rect.rows, rect.cols };
+        out.write(reinterpret_cast<const char*>(r), sizeof(r));
+        out.write(reinterpret_cast<const char*>(rect.tiles.data()), rect.tiles.size());
+    }
+}
+
+inline MapPatch LoadPatch(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) throw std::runtime_error("Error: could not open patch '" + path + "'");
+    // Counts and sizes read from the file are checked against what is left of it before
+    // anything is allocated, so a corrupt patch fails instead of asking for gigabytes
+    const std::uint64_t fileSize = (std::uint64_t)in.tellg();
+    in.seekg(0);
+    auto remaining = [&in, fileSize]() { return fileSize - (std::uint64_t)in.tellg(); };
+    char magic[4];
+    std::uint32_t version, count;
+    std::int32_t header[4];
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || std::memcmp(magic, "MPAT", 4) != 0 || version != MPATCH_VERSION)
+        throw std::runtime_error("File error: '" + path + "' is not a valid patch");
+
+    MapPatch patch;
+    patch.baseRows = header[0];
+    patch.baseCols = header[1];
+    patch.rows = header[2];
+    patch.cols = header[3];
+    if (count > remaining() / (4 * sizeof(std::int32_t))) throw std::runtime_error("File error: truncated patch '" + path + "'");
+    patch.rects.resize(count);
+    for (DiffRect& rect : patch.rects)
+    {
+        std::int32_t r[4];
+        in.read(reinterpret_cast<char*>(r), sizeof(r));
+        if (!in || r[2] < 0 || r[3] < 0 || (std::uint64_t)r[2] * (std::uint64_t)r[3] > remaining())
+            throw std::runtime_error("File error: truncated patch '" + path + "'");
+        rect.row = r[0];
+        rect.col = r[1];
+        rect.rows = r[2];
+        rect.cols = r[3];
+        rect.tiles.resize((std::size_t)rect.rows * rect.cols);
+        in.read(reinterpret_cast<char*>(rect.tiles.data()), rect.tiles.size());
+        if (!in) throw std::runtime_error("File error: truncated patch '" + path + "'");
+    }
+    return patch;
+}
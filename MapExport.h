@@ -0,0 +1,161 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "ParallelFor.h"
+
+// CPU-only map rendering, for exporting previews/thumbnails without a GPU or window.
+//
+// Tile textures are pre-scaled once to the output tile size, then each worker
+// composites its own band of map rows straight into one RGBA buffer.
+
+// Reads tile types [0, cols) of a map row into out. Must be safe to call from
+// several threads at once unless the export is run with one thread.
+using MapRowReader = std::function<void(int row, std::uint8_t* out)>;
+
+// Largest exported image: PNG encoders take int sizes and a 2 GB RGBA buffer is already a lot
+const std::uint64_t EXPORT_MAX_SIDE = 65535;
+const std::uint64_t EXPORT_MAX_PIXELS = 1ull << 29;
+
+// Size of a full export in pixels, computed in 64 bits. False if it is over the limits above.
+inline bool exportImageSize(int rows, int cols, int pixelsPerTile, std::uint64_t& width, std::uint64_t& height)
+{
+    width = (std::uint64_t)cols * (std::uint64_t)pixelsPerTile;
+    height = (std::uint64_t)rows * (std::uint64_t)pixelsPerTile;
+    return width <= EXPORT_MAX_SIDE && height <= EXPORT_MAX_SIDE && width * height <= EXPORT_MAX_PIXELS;
+}
+
+// One tile texture, RGBA
+struct TileImage
+{
+    int width = 0, height = 0;
+    std::vector<std::uint8_t> pixels;
+};
+
+// Every tile type scaled to pixelsPerTile x pixelsPerTile
+struct TilePalette
+{
+    int pixelsPerTile = 1;
+    std::vector<std::vector<std::uint8_t>> tiles;
+    // Average colour of each tile type, packed RGBA
+    std::vector<std::uint32_t> averageColor;
+};
+
+// Box filter when shrinking, nearest neighbour when growing
+inline TilePalette BuildTilePalette(const std::vector<TileImage>& images, int pixelsPerTile)
+{
+    TilePalette palette;
+    palette.pixelsPerTile = pixelsPerTile;
+    for (const TileImage& img : images)
+    {
+        std::vector<std::uint8_t> scaled((std::size_t)pixelsPerTile * pixelsPerTile * 4, 0);
+        std::uint64_t total[4] = { 0, 0, 0, 0 };
+        for (std::size_t p = 0; p < img.pixels.size(); p++) total[p % 4] += img.pixels[p];
+        std::size_t count = (std::size_t)img.width * img.height;
+        std::uint8_t avg[4] = { 0, 0, 0, 0 };
+        for (int ch = 0; ch < 4 && count > 0; ch++) avg[ch] = (std::uint8_t)(total[ch] / count);
+        std::uint32_t packed;
+        std::memcpy(&packed, avg, 4);
+        palette.averageColor.push_back(packed);
+
+        for (int dy = 0; dy < pixelsPerTile && count > 0; dy++)
+        {
+            int sy0 = dy * img.height / pixelsPerTile;
+            int sy1 = std::max(sy0 + 1, (dy + 1) * img.height / pixelsPerTile);
+            for (int dx = 0; dx < pixelsPerTile; dx++)
+            {
+                int sx0 = dx * img.width / pixelsPerTile;
+                int sx1 = std::max(sx0 + 1, (dx + 1) * img.width / pixelsPerTile);
+                std::uint32_t sum[4] = { 0, 0, 0, 0 };
+                for (int sy = sy0; sy < sy1; sy++)
+                {
+                    for (int sx = sx0; sx < sx1; sx++)
+                    {
+                        const std::uint8_t* px = &img.pixels[((std::size_t)sy * img.width + sx) * 4];
+                        for (int ch = 0; ch < 4; ch++) sum[ch] += px[ch];
+                    }
+                }
+                std::uint32_t n = (std::uint32_t)((sy1 - sy0) * (sx1 - sx0));
+                std::uint8_t* dst = &scaled[((std::size_t)dy * pixelsPerTile + dx) * 4];
+                for (int ch = 0; ch < 4; ch++) dst[ch] = (std::uint8_t)(sum[ch] / n);
+            }
+        }
+        palette.tiles.push_back(std::move(scaled));
+    }
+    return palette;
+}
+
+// Renders the map at palette.pixelsPerTile into an RGBA buffer of
+// (cols * ppt) x (rows * ppt), rows split across threads
+inline std::vector<std::uint8_t> CompositeMap(int rows, int cols, const MapRowReader& readRow, const TilePalette& palette, int threads = 0)
+{
+    const int ppt = palette.pixelsPerTile;
+    const std::size_t stride = (std::size_t)cols * ppt * 4;
+    std::vector<std::uint8_t> out(stride * rows * ppt);
+
+    parallelFor(rows, [&](int begin, int end)
+    {
+        std::vector<std::uint8_t> types(cols);
+        for (int r = begin; r < end; r++)
+        {
+            readRow(r, types.data());
+            if (ppt == 1)
+            {
+                // One pixel per tile: straight 32-bit stores
+                std::uint8_t* dst = &out[stride * r];
+                for (int c = 0; c < cols; c++) std::memcpy(dst + (std::size_t)c * 4, &palette.averageColor[types[c]], 4);
+                continue;
+            }
+            for (int py = 0; py < ppt; py++)
+            {
+                std::uint8_t* dst = &out[stride * ((std::size_t)r * ppt + py)];
+                for (int c = 0; c < cols; c++)
+                {
+                    std::memcpy(dst + (std::size_t)c * ppt * 4, &palette.tiles[types[c]][(std::size_t)py * ppt * 4], (std::size_t)ppt * 4);
+                }
+            }
+        }
+    }, threads);
+    return out;
+}
+
+// Renders a thumbnail where every pixel averages a tilesPerPixel x tilesPerPixel
+// block of tiles. Output is ceil(cols / k) x ceil(rows / k) RGBA.
+inline std::vector<std::uint8_t> CompositeThumbnail(int rows, int cols, const MapRowReader& readRow, const TilePalette& palette, int tilesPerPixel, int threads = 0)
+{
+    const int k = tilesPerPixel;
+    const int outW = (cols + k - 1) / k;
+    const int outH = (rows + k - 1) / k;
+    std::vector<std::uint8_t> out((std::size_t)outW * outH * 4);
+
+    parallelFor(outH, [&](int begin, int end)
+    {
+        std::vector<std::uint8_t> types(cols);
+        std::vector<std::uint32_t> sums((std::size_t)outW * 4);
+        for (int oy = begin; oy < end; oy++)
+        {
+            std::fill(sums.begin(), sums.end(), 0);
+            int r1 = std::min(rows, (oy + 1) * k);
+            for (int r = oy * k; r < r1; r++)
+            {
+                readRow(r, types.data());
+                for (int c = 0; c < cols; c++)
+                {
+                    const std::uint8_t* color = reinterpret_cast<const std::uint8_t*>(&palette.averageColor[types[c]]);
+                    std::uint32_t* s = &sums[(std::size_t)(c / k) * 4];
+                    s[0] += color[0];
+                    s[1] += color[1];
+                    s[2] += color[2];
+                    s[3] += color[3];
+                }
+            }
+            for (int ox = 0; ox < outW; ox++)
+            {
+                std::uint32_t n = (std::uint32_t)((r1 - oy * k) * (std::min(cols, (ox + 1) * k) - ox * k));
+                for (int ch = 0; ch < 4; ch++) out[((std::size_t)oy * outW + ox) * 4 + ch] = (std::uint8_t)(sums[(std::size_t)ox * 4 + ch] / n);
+            }
+        }
+    }, threads);
+    return out;
+}
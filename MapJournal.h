@@ -0,0 +1,460 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Autosave journal.
+//
+// The editor periodically snapshots the chunks changed since the last checkpoint and
+// hands them to a worker thread, which appends them to <map>.journal. The main thread
+// only queues jobs, all disk work (opening, appending, compacting, deleting, reading back
+// for recovery) happens on the worker, so nothing here ever blocks a frame.
+// When the same map is opened again the worker reads the journal back and the editor
+// offers to replay it on top of the loaded tiles.
+//
+// .journal layout:
+//   "MJNL" | uint32 version | int32 rows | int32 cols | int32 chunkSize
+//          | uint64 base size | int64 base mtime | uint32 base hash
+//   records: int32 chunkRow | int32 chunkCol | uint32 checksum | chunkSize * chunkSize tile bytes
+// The base fields identify the map file the edits were made against. If that file
+// changed since (saved elsewhere, edited by hand) the journal is stale and is discarded.
+// Later records for the same chunk replace earlier ones. A torn record at the end
+// (crash mid-write) fails its checksum and ends the replay.
+
+const std::uint32_t JOURNAL_VERSION = 2;
+
+struct JournalRecord
+{
+    std::int32_t chunkRow = 0;
+    std::int32_t chunkCol = 0;
+    // chunkSize * chunkSize tiles, row major (tiles past the map edge are 0)
+    std::vector<std::uint8_t> tiles;
+};
+
+// The map file a journal belongs to, all zero if it does not exist (untitled maps)
+struct JournalBase
+{
+    std::uint64_t size = 0;
+    std::int64_t time = 0;
+    std::uint32_t hash = 0;
+
+    bool operator==(const JournalBase& other) const { return size == other.size && time == other.time && hash == other.hash; }
+    bool operator!=(const JournalBase& other) const { return !(*this == other); }
+};
+
+// FNV-1a
+inline void journalHash(std::uint32_t& h, const std::uint8_t* p, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; i++) { h ^= p[i]; h *= 16777619u; }
+}
+
+inline std::uint32_t journalChecksum(const JournalRecord& rec)
+{
+    std::uint32_t h = 2166136261u;
+    journalHash(h, reinterpret_cast<const std::uint8_t*>(&rec.chunkRow), sizeof(rec.chunkRow));
+    journalHash(h, reinterpret_cast<const std::uint8_t*>(&rec.chunkCol), sizeof(rec.chunkCol));
+    journalHash(h, rec.tiles.data(), rec.tiles.size());
+    return h;
+}
+
+// Size, mtime and content hash of mapPath. Reads the whole file, call it from the worker.
+inline JournalBase journalBaseOf(const std::string& mapPath)
+{
+    JournalBase base;
+    if (mapPath.empty()) return base;
+    std::error_code ec;
+    std::uintmax_t size = std::filesystem::file_size(mapPath, ec);
+    if (ec) return base;
+    auto time = std::filesystem::last_write_time(mapPath, ec);
+    if (ec) return base;
+    base.size = size;
+    base.time = (std::int64_t)time.time_since_epoch().count();
+
+    std::ifstream in(mapPath, std::ios::binary);
+    std::vector<char> buffer(1 << 16);
+    base.hash = 2166136261u;
+    while (in)
+    {
+        in.read(buffer.data(), buffer.size());
+        journalHash(base.hash, reinterpret_cast<const std::uint8_t*>(buffer.data()), (std::size_t)in.gcount());
+    }
+    return base;
+}
+
+class AutosaveJournal
+{
+private:
+    struct Job
+    {
+        enum class Kind { OPEN, RECORDS, RESET, CLOSE };
+        Kind kind = Kind::RECORDS;
+        // OPEN
+        std::string path;
+        std::string basePath;
+        int rows = 0, cols = 0, chunkSize = 0;
+        bool recover = false;
+        std::uint32_t session = 0;
+        // CLOSE: delete the journal too
+        bool remove = false;
+        // RECORDS
+        std::vector<JournalRecord> records;
+    };
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Job> jobs;
+    bool shuttingDown = false;
+
+    // Main thread: a journal is open (or queued to be)
+    bool running = false;
+    std::string mainPath;
+    std::uint32_t session = 0;
+
+    // Handed from the worker to the main thread, guarded by mutex
+    std::vector<JournalRecord> recovered;
+    std::uint32_t recoveredSession = 0;
+
+    // Worker only: the journal being written
+    std::ofstream out;
+    std::string path;
+    std::string basePath;
+    int rows = 0, cols = 0, chunkSize = 0;
+    JournalBase base;
+    // Journal size right after the last compaction
+    std::size_t compactedSize = 0;
+
+    void writeHeader(std::ofstream& file)
+    {
+        std::int32_t header[3] = { rows, cols, chunkSize };
+        file.write("MJNL", 4);
+        file.write(reinterpret_cast<const char*>(&JOURNAL_VERSION), sizeof(JOURNAL_VERSION));
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(&base.size), sizeof(base.size));
+        file.write(reinterpret_cast<const char*>(&base.time), sizeof(base.time));
+        file.write(reinterpret_cast<const char*>(&base.hash), sizeof(base.hash));
+    }
+
+    static void writeRecord(std::ofstream& file, const JournalRecord& rec)
+    {
+        std::uint32_t checksum = journalChecksum(rec);
+        file.write(reinterpret_cast<const char*>(&rec.chunkRow), sizeof(rec.chunkRow));
+        file.write(reinterpret_cast<const char*>(&rec.chunkCol), sizeof(rec.chunkCol));
+        file.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+        file.write(reinterpret_cast<const char*>(rec.tiles.data()), rec.tiles.size());
+    }
+
+    std::size_t fileSize()
+    {
+        std::error_code ec;
+        std::uintmax_t size = std::filesystem::file_size(path, ec);
+        return ec ? 0 : (std::size_t)size;
+    }
+
+    // Worker: the latest record of every chunk in the journal, or -1 if it is not a journal of this map
+    int readLatest(std::vector<JournalRecord>& records)
+    {
+        std::unordered_map<std::int64_t, std::size_t> latest;
+        return Replay(path, rows, cols, chunkSize, base, [&](const JournalRecord& rec)
+        {
+            std::int64_t key = ((std::int64_t)rec.chunkRow << 32) | (std::uint32_t)rec.chunkCol;
+            auto it = latest.find(key);
+            if (it == latest.end())
+            {
+                latest[key] = records.size();
+                records.push_back(rec);
+            }
+            else records[it->second] = rec;
+        });
+    }
+
+    // Worker: replaces the journal with header + records, via a temp file + rename
+    bool rewrite(const std::vector<JournalRecord>& records)
+    {
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            writeHeader(file);
+            for (const JournalRecord& rec : records) writeRecord(file, rec);
+            if (!file) return false; // keep the old journal
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmpPath, path, ec);
+        if (ec)
+        {
+            std::cerr << "Autosave: could not rewrite journal: " << ec.message() << "\n";
+            std::filesystem::remove(tmpPath, ec);
+            return false;
+        }
+        return true;
+    }
+
+    // Worker: starts an empty journal for the current base
+    void truncate()
+    {
+        out.close();
+        out.open(path, std::ios::binary | std::ios::trunc);
+        writeHeader(out);
+        out.flush();
+        if (!out) std::cerr << "Autosave: could not write to '" << path << "'\n";
+        compactedSize = 0;
+    }
+
+    void open(Job& job)
+    {
+        out.close();
+        path = job.path;
+        basePath = job.basePath;
+        rows = job.rows;
+        cols = job.cols;
+        chunkSize = job.chunkSize;
+        base = journalBaseOf(basePath);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            recovered.clear();
+        }
+
+        std::vector<JournalRecord> records;
+        int count = job.recover ? readLatest(records) : -1;
+        if (count < 0 || records.empty())
+        {
+            std::error_code ec;
+            if (job.recover && count < 0 && std::filesystem::exists(path, ec))
+                std::cout << "Autosave: '" << path << "' does not match the map on disk, discarding it\n";
+            truncate();
+            return;
+        }
+
+        // Drop superseded records (and a torn tail) before appending after them
+        if (rewrite(records)) out.open(path, std::ios::binary | std::ios::app);
+        else
+        {
+            // The old file may end in a torn record that would hide everything appended
+            // after it, so start it over in place with the records that were read back
+            std::cerr << "Autosave: could not compact '" << path << "', rewriting it in place\n";
+            truncate();
+            for (const JournalRecord& rec : records) writeRecord(out, rec);
+            out.flush();
+            if (!out) std::cerr << "Autosave: could not write to '" << path << "'\n";
+        }
+        compactedSize = fileSize();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            recovered = std::move(records);
+            recoveredSession = job.session;
+        }
+    }
+
+    void append(const std::vector<JournalRecord>& records)
+    {
+        if (!out.is_open()) return;
+        for (const JournalRecord& rec : records) writeRecord(out, rec);
+        out.flush();
+        if (!out) std::cerr << "Autosave: could not write to '" << path << "'\n";
+
+        // Compact once the journal has doubled since the last compaction
+        std::size_t size = (std::size_t)out.tellp();
+        if (size > compactThreshold && size > 2 * compactedSize)
+        {
+            out.close();
+            std::vector<JournalRecord> latest;
+            if (readLatest(latest) >= 0) rewrite(latest);
+            out.open(path, std::ios::binary | std::ios::app);
+            compactedSize = fileSize();
+        }
+    }
+
+    void close(bool remove)
+    {
+        out.close();
+        if (!remove) return;
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+
+    void run()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return shuttingDown || !jobs.empty(); });
+                if (jobs.empty()) break; // shutting down and drained
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            switch (job.kind)
+            {
+            case Job::Kind::OPEN: open(job); break;
+            case Job::Kind::RECORDS: append(job.records); break;
+            case Job::Kind::RESET:
+                // The map file was just saved, the journal now starts from it
+                base = journalBaseOf(basePath);
+                truncate();
+                break;
+            case Job::Kind::CLOSE: close(job.remove); break;
+            }
+        }
+        out.close();
+    }
+
+    void queue(Job job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        cv.notify_one();
+    }
+
+public:
+    // Journal size (bytes) that triggers a background compaction
+    std::size_t compactThreshold = 64u * 1024 * 1024;
+
+    ~AutosaveJournal() { Shutdown(); }
+
+    bool isRunning() const { return running; }
+    const std::string& getPath() const { return mainPath; }
+
+    // Main thread: starts journaling a rows x cols map loaded from basePath to _path.
+    // With recover, the records already in there are read back and handed out by TakeRecovered,
+    // otherwise (or if they were written against a different version of the map) it starts empty.
+    void Start(std::string _path, std::string basePath, int rows, int cols, int chunkSize, bool recover)
+    {
+        Stop();
+        if (!worker.joinable())
+        {
+            shuttingDown = false;
+            worker = std::thread(&AutosaveJournal::run, this);
+        }
+        Job job;
+        job.kind = Job::Kind::OPEN;
+        job.path = _path;
+        job.basePath = basePath;
+        job.rows = rows;
+        job.cols = cols;
+        job.chunkSize = chunkSize;
+        job.recover = recover;
+        job.session = ++session;
+        queue(std::move(job));
+        mainPath = _path;
+        running = true;
+    }
+
+    // Main thread: closes the journal once everything queued is written, deleting it with remove.
+    // Never waits for the worker.
+    void Stop(bool remove = false)
+    {
+        if (!running) return;
+        Job job;
+        job.kind = Job::Kind::CLOSE;
+        job.remove = remove;
+        queue(std::move(job));
+        running = false;
+    }
+
+    // Main thread: queue a checkpoint, never touches the disk
+    void Submit(std::vector<JournalRecord> records)
+    {
+        if (!running || records.empty()) return;
+        Job job;
+        job.records = std::move(records);
+        queue(std::move(job));
+    }
+
+    // Main thread: everything is in the map file now, drop the journal contents
+    void Reset()
+    {
+        if (!running) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // Checkpoints of this journal that are not written yet are saved already.
+            // Jobs before its OPEN belong to earlier journals and still have to run.
+            while (!jobs.empty() && jobs.back().kind == Job::Kind::RECORDS) jobs.pop_back();
+            Job job;
+            job.kind = Job::Kind::RESET;
+            jobs.push_back(std::move(job));
+        }
+        cv.notify_one();
+    }
+
+    // Main thread: the records read back by the last Start(..., recover = true), once.
+    // False until the worker got to it, or if there was nothing to recover.
+    bool TakeRecovered(std::vector<JournalRecord>& records)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running || recoveredSession != session || recovered.empty()) return false;
+        records = std::move(recovered);
+        recovered.clear();
+        return true;
+    }
+
+    // Writes out everything queued and joins the worker (on exit)
+    void Shutdown()
+    {
+        if (!worker.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            shuttingDown = true;
+        }
+        cv.notify_one();
+        worker.join();
+        running = false;
+    }
+
+    // Calls apply for every intact record of the journal at path, in order.
+    // Returns the number of records, or -1 if there is no journal for this map (size or base file differ).
+    static int Replay(const std::string& path, int rows, int cols, int chunkSize, const JournalBase& base, const std::function<void(const JournalRecord&)>& apply)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) return -1;
+
+        char magic[4];
+        std::uint32_t version;
+        std::int32_t header[3];
+        JournalBase written;
+        in.read(magic, 4);
+        in.read(reinterpret_cast<char*>(&version), sizeof(version));
+        in.read(reinterpret_cast<char*>(header), sizeof(header));
+        in.read(reinterpret_cast<char*>(&written.size), sizeof(written.size));
+        in.read(reinterpret_cast<char*>(&written.time), sizeof(written.time));
+        in.read(reinterpret_cast<char*>(&written.hash), sizeof(written.hash));
+        if (!in || std::memcmp(magic, "MJNL", 4) != 0 || version != JOURNAL_VERSION) return -1;
+        if (header[0] != rows || header[1] != cols || header[2] != chunkSize) return -1;
+        if (written != base) return -1;
+
+        int count = 0;
+        JournalRecord rec;
+        rec.tiles.resize((std::size_t)chunkSize * chunkSize);
+        while (true)
+        {
+            std::uint32_t checksum;
+            in.read(reinterpret_cast<char*>(&rec.chunkRow), sizeof(rec.chunkRow));
+            in.read(reinterpret_cast<char*>(&rec.chunkCol), sizeof(rec.chunkCol));
+            in.read(reinterpret_cast<char*>(&checksum), sizeof(checksum));
+            in.read(reinterpret_cast<char*>(rec.tiles.data()), rec.tiles.size());
+            if (!in) break;
+            if (journalChecksum(rec) != checksum)
+            {
+                std::cerr << "Autosave: journal '" << path << "' has a damaged record, stopping replay there\n";
+                break;
+            }
+            apply(rec);
+            count++;
+        }
+        return count;
+    }
+};
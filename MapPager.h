@@ -0,0 +1,342 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Paged (out-of-core) map storage.
+//
+// .pmap layout (little endian):
+//   "PMAP" | uint32 version | int32 rows | int32 cols | int32 chunkSize | int32 reserved
+//   uint64 offset[chunksY * chunksX]   (0 = chunk never written, all BLANK)
+//   chunk data, chunkSize * chunkSize bytes each (one tile type per byte)
+//
+// Chunks are loaded on demand into an LRU cache bounded by memoryBudget and
+// written back when evicted or flushed, so the whole grid never has to fit in RAM.
+
+const int CHUNK_SIZE = 64;
+const std::uint32_t PMAP_VERSION = 1;
+const std::streamoff PMAP_HEADER_SIZE = 24;
+
+struct PageCacheStats
+{
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t prefetched = 0;
+    std::uint64_t evictions = 0;
+    std::uint64_t writeBacks = 0;
+
+    float hitRate() const
+    {
+        std::uint64_t total = hits + misses;
+        return total == 0 ? 1.0f : (float)hits / total;
+    }
+};
+
+class MapPager
+{
+private:
+    struct Chunk
+    {
+        std::vector<std::uint8_t> tiles;
+        bool dirty = false;
+        std::list<int>::iterator lruPos;
+    };
+
+    std::fstream file;
+    std::string path;
+    std::vector<std::uint64_t> chunkOffsets;
+    std::unordered_map<int, Chunk> chunks;
+    // Most recently used chunk id at the front
+    std::list<int> lru;
+
+    // Fast path for runs of accesses inside the same chunk
+    int lastChunkId = -1;
+    Chunk* lastChunk = nullptr;
+
+    static std::size_t chunkBytes() { return CHUNK_SIZE * CHUNK_SIZE + sizeof(Chunk) + 32; }
+
+    std::size_t maxResidentChunks() const
+    {
+        std::size_t n = memoryBudget / chunkBytes();
+        return n < 16 ? 16 : n;
+    }
+
+    void readChunk(int id, Chunk& chunk)
+    {
+        chunk.tiles.assign(CHUNK_SIZE * CHUNK_SIZE, 0);
+        if (chunkOffsets[id] == 0) return; // never written, all blank
+        file.seekg((std::streamoff)chunkOffsets[id]);
+        file.read(reinterpret_cast<char*>(chunk.tiles.data()), chunk.tiles.size());
+        if (!file) throw std::runtime_error("Error: could not read chunk from '" + path + "'");
+    }
+
+    void writeChunk(int id, Chunk& chunk)
+    {
+        if (chunkOffsets[id] == 0)
+        {
+            // Blank chunks stay unallocated on disk
+            bool allBlank = true;
+            for (std::uint8_t t : chunk.tiles)
+            {
+                if (t != 0) { allBlank = false; break; }
+            }
+            if (allBlank) { chunk.dirty = false; return; }
+
+            // Append and point the index at it
+            file.seekp(0, std::ios::end);
+            chunkOffsets[id] = (std::uint64_t)file.tellp();
+            file.write(reinterpret_cast<const char*>(chunk.tiles.data()), chunk.tiles.size());
+            file.seekp(PMAP_HEADER_SIZE + (std::streamoff)id * sizeof(std::uint64_t));
+            file.write(reinterpret_cast<const char*>(&chunkOffsets[id]), sizeof(std::uint64_t));
+        }
+        else
+        {
+            file.seekp((std::streamoff)chunkOffsets[id]);
+            file.write(reinterpret_cast<const char*>(chunk.tiles.data()), chunk.tiles.size());
+        }
+        if (!file) throw std::runtime_error("Error: could not write chunk to '" + path + "'");
+        chunk.dirty = false;
+        stats.writeBacks++;
+    }
+
+    void evictOne()
+    {
+        int id = lru.back();
+        Chunk& chunk = chunks[id];
+        if (chunk.dirty) writeChunk(id, chunk);
+        lru.pop_back();
+        chunks.erase(id);
+        if (lastChunkId == id) { lastChunkId = -1; lastChunk = nullptr; }
+        stats.evictions++;
+    }
+
+    // Loads chunk id (evicting LRU chunks if over budget)
+    Chunk& load(int id)
+    {
+        while (chunks.size() >= maxResidentChunks()) evictOne();
+        Chunk& chunk = chunks[id];
+        readChunk(id, chunk);
+        lru.push_front(id);
+        chunk.lruPos = lru.begin();
+        return chunk;
+    }
+
+    Chunk& fault(int id)
+    {
+        if (id == lastChunkId)
+        {
+            stats.hits++;
+            return *lastChunk;
+        }
+        auto it = chunks.find(id);
+        Chunk* chunk;
+        if (it != chunks.end())
+        {
+            stats.hits++;
+            chunk = &it->second;
+            lru.splice(lru.begin(), lru, chunk->lruPos);
+        }
+        else
+        {
+            stats.misses++;
+            chunk = &load(id);
+        }
+        lastChunkId = id;
+        lastChunk = chunk;
+        return *chunk;
+    }
+
+    int chunkId(int r, int c) const { return (r / CHUNK_SIZE) * chunksX + (c / CHUNK_SIZE); }
+
+public:
+    int rows = 0, cols = 0;
+    int chunksX = 0, chunksY = 0;
+    // Max bytes of chunk data kept in memory
+    std::size_t memoryBudget = 256u * 1024 * 1024;
+    // How many chunk rings ahead of the camera to load while it moves
+    int prefetchDistance = 2;
+    PageCacheStats stats;
+
+    bool isOpen() const { return file.is_open(); }
+    std::size_t residentChunks() const { return chunks.size(); }
+    std::size_t residentBytes() const { return chunks.size() * chunkBytes(); }
+    const std::string& getPath() const { return path; }
+
+    // Creates a new all-blank paged map file
+    bool Create(std::string _path, int _rows, int _cols)
+    {
+        Close();
+        std::ofstream out(_path, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+
+        std::int32_t header[4] = { _rows, _cols, CHUNK_SIZE, 0 };
+        out.write("PMAP", 4);
+        out.write(reinterpret_cast<const char*>(&PMAP_VERSION), sizeof(PMAP_VERSION));
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+        std::size_t count = (std::size_t)((_rows + CHUNK_SIZE - 1) / CHUNK_SIZE) * ((_cols + CHUNK_SIZE - 1) / CHUNK_SIZE);
+        std::vector<std::uint64_t> zeroIndex(count, 0);
+        out.write(reinterpret_cast<const char*>(zeroIndex.data()), zeroIndex.size() * sizeof(std::uint64_t));
+        out.close();
+        return Open(_path);
+    }
+
+    bool Open(std::string _path)
+    {
+        Close();
+        file.open(_path, std::ios::in | std::ios::out | std::ios::binary);
+        if (!file.is_open()) return false;
+
+        char magic[4];
+        std::uint32_t version;
+        std::int32_t header[4];
+        file.read(magic, 4);
+        file.read(reinterpret_cast<char*>(&version), sizeof(version));
+        file.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (!file || std::memcmp(magic, "PMAP", 4) != 0 || version != PMAP_VERSION || header[2] != CHUNK_SIZE)
+        {
+            file.close();
+            throw std::runtime_error("File error: '" + _path + "' is not a valid .pmap file");
+        }
+
+        path = _path;
+        rows = header[0];
+        cols = header[1];
+        chunksX = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        chunksY = (rows + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        chunkOffsets.assign((std::size_t)chunksX * chunksY, 0);
+        file.read(reinterpret_cast<char*>(chunkOffsets.data()), chunkOffsets.size() * sizeof(std::uint64_t));
+        if (!file)
+        {
+            file.close();
+            throw std::runtime_error("File error: truncated chunk index in '" + _path + "'");
+        }
+        stats = PageCacheStats();
+        return true;
+    }
+
+    // Writes back all dirty chunks (keeps them resident)
+    void Flush()
+    {
+        if (!isOpen()) return;
+        for (auto& [id, chunk] : chunks)
+        {
+            if (chunk.dirty) writeChunk(id, chunk);
+        }
+        file.flush();
+    }
+
+    void Close()
+    {
+        if (!isOpen()) return;
+        Flush();
+        file.close();
+        chunks.clear();
+        lru.clear();
+        chunkOffsets.clear();
+        lastChunkId = -1;
+        lastChunk = nullptr;
+    }
+
+    std::uint8_t getType(int r, int c)
+    {
+        Chunk& chunk = fault(chunkId(r, c));
+        return chunk.tiles[(r % CHUNK_SIZE) * CHUNK_SIZE + (c % CHUNK_SIZE)];
+    }
+
+    void setType(int r, int c, std::uint8_t t)
+    {
+        Chunk& chunk = fault(chunkId(r, c));
+        std::uint8_t& tile = chunk.tiles[(r % CHUNK_SIZE) * CHUNK_SIZE + (c % CHUNK_SIZE)];
+        if (tile == t) return;
+        tile = t;
+        chunk.dirty = true;
+    }
+
+    // Copies tiles [c0, c0 + n) of row r into out, a chunk segment at a time
+    void readRow(int r, int c0, int n, std::uint8_t* out)
+    {
+        int c = c0;
+        int end = c0 + n;
+        while (c < end)
+        {
+            int chunkEnd = std::min(end, (c / CHUNK_SIZE + 1) * CHUNK_SIZE);
+            Chunk& chunk = fault(chunkId(r, c));
+            std::memcpy(out + (c - c0), &chunk.tiles[(r % CHUNK_SIZE) * CHUNK_SIZE + (c % CHUNK_SIZE)], chunkEnd - c);
+            c = chunkEnd;
+        }
+    }
+
+    // Copies in into tiles [c0, c0 + n) of row r, a chunk segment at a time
+    void writeRow(int r, int c0, int n, const std::uint8_t* in)
+    {
+        int c = c0;
+        int end = c0 + n;
+        while (c < end)
+        {
+            int chunkEnd = std::min(end, (c / CHUNK_SIZE + 1) * CHUNK_SIZE);
+            Chunk& chunk = fault(chunkId(r, c));
+            std::uint8_t* dst = &chunk.tiles[(r % CHUNK_SIZE) * CHUNK_SIZE + (c % CHUNK_SIZE)];
+            if (std::memcmp(dst, in + (c - c0), chunkEnd - c) != 0)
+            {
+                std::memcpy(dst, in + (c - c0), chunkEnd - c);
+                chunk.dirty = true;
+            }
+            c = chunkEnd;
+        }
+    }
+
+    // Call once per frame with the visible tile rect [r0,r1) x [c0,c1).
+    // Faults in the visible chunks and prefetches ahead of the camera movement.
+    void Update(int r0, int c0, int r1, int c1, float axisX, float axisY)
+    {
+        if (!isOpen() || r1 <= r0 || c1 <= c0) return;
+        int cr0 = r0 / CHUNK_SIZE, cr1 = (r1 - 1) / CHUNK_SIZE;
+        int cc0 = c0 / CHUNK_SIZE, cc1 = (c1 - 1) / CHUNK_SIZE;
+
+        for (int cr = cr0; cr <= cr1; cr++)
+        {
+            for (int cc = cc0; cc <= cc1; cc++) fault(cr * chunksX + cc);
+        }
+
+        int dx = axisX > 0 ? 1 : (axisX < 0 ? -1 : 0);
+        int dy = axisY > 0 ? 1 : (axisY < 0 ? -1 : 0);
+        if (dx == 0 && dy == 0) return;
+
+        // Never prefetch so much that the visible chunks get evicted
+        std::size_t visible = (std::size_t)(cr1 - cr0 + 1) * (cc1 - cc0 + 1);
+        std::size_t budget = maxResidentChunks();
+        if (visible >= budget) return;
+        std::size_t spare = budget - visible;
+
+        for (int d = 1; d <= prefetchDistance; d++)
+        {
+            // Shift the visible chunk rect d chunks along the movement axis
+            int pr0 = cr0 + dy * d, pr1 = cr1 + dy * d;
+            int pc0 = cc0 + dx * d, pc1 = cc1 + dx * d;
+            for (int cr = pr0; cr <= pr1; cr++)
+            {
+                for (int cc = pc0; cc <= pc1; cc++)
+                {
+                    if (cr < 0 || cr >= chunksY || cc < 0 || cc >= chunksX) continue;
+                    // Already in the visible rect
+                    if (cr >= cr0 && cr <= cr1 && cc >= cc0 && cc <= cc1) continue;
+                    int id = cr * chunksX + cc;
+                    if (chunks.count(id)) continue;
+                    if (spare == 0) return;
+                    spare--;
+
+                    load(id);
+                    stats.prefetched++;
+                }
+            }
+        }
+    }
+};
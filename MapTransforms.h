@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "ParallelFor.h"
+#include "TileBlock.h"
+
+// Flips, 90 degree rotations and transposes of tile rectangles, plus the mirror
+// points used by symmetry painting.
+//
+// Flips and the 180 degree rotation copy whole rows. Rotations and the transpose read
+// the source by column, so the output is produced in TRANSFORM_BLOCK x TRANSFORM_BLOCK
+// tiles: each output tile only touches TRANSFORM_BLOCK source rows, which stay in the
+// cache, instead of one cache miss per tile on big maps. Output block rows are split
+// between worker threads.
+
+enum class MAPTRANSFORM { FLIP_H = 0, FLIP_V = 1, ROTATE_CW = 2, ROTATE_CCW = 3, ROTATE_180 = 4, TRANSPOSE = 5 };
+const std::array<std::string, 6> mapTransformString = { "flip_h", "flip_v", "rotate_cw", "rotate_ccw", "rotate_180", "transpose" };
+
+// Mirror painting: HORIZONTAL mirrors left/right, VERTICAL top/bottom, BOTH does both
+enum class SYMMETRY { NONE = 0, HORIZONTAL = 1, VERTICAL = 2, BOTH = 3 };
+const std::array<std::string, 4> symmetryString = { "off", "horizontal", "vertical", "both" };
+
+const int TRANSFORM_BLOCK = 64;
+
+// Rows and cols swap places
+inline bool transformSwapsAxes(MAPTRANSFORM t)
+{
+    return t == MAPTRANSFORM::ROTATE_CW || t == MAPTRANSFORM::ROTATE_CCW || t == MAPTRANSFORM::TRANSPOSE;
+}
+
+// Parses one of mapTransformString, false if it is none of them
+inline bool parseTransform(const std::string& name, MAPTRANSFORM& out)
+{
+    for (std::size_t i = 0; i < mapTransformString.size(); i++)
+    {
+        if (mapTransformString[i] == name)
+        {
+            out = static_cast<MAPTRANSFORM>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// dst(i, j) = src[srcIndex(i, j)], one output block at a time
+template <class SrcIndex>
+void transformBlocked(const TileBlock& src, TileBlock& dst, SrcIndex srcIndex, int threads)
+{
+    int blockRows = (dst.rows + TRANSFORM_BLOCK - 1) / TRANSFORM_BLOCK;
+    const std::uint8_t* in = src.tiles.data();
+    parallelFor(blockRows, [&](int b0, int b1)
+    {
+        for (int b = b0; b < b1; b++)
+        {
+            int i0 = b * TRANSFORM_BLOCK, i1 = std::min(i0 + TRANSFORM_BLOCK, dst.rows);
+            for (int j0 = 0; j0 < dst.cols; j0 += TRANSFORM_BLOCK)
+            {
+                int j1 = std::min(j0 + TRANSFORM_BLOCK, dst.cols);
+                for (int i = i0; i < i1; i++)
+                {
+                    std::uint8_t* out = dst.row(i);
+                    for (int j = j0; j < j1; j++) out[j] = in[srcIndex(i, j)];
+                }
+            }
+        }
+    }, threads);
+}
+
+// Returns src transformed by t (rows and cols swapped for rotations and the transpose)
+inline TileBlock TransformBlock(const TileBlock& src, MAPTRANSFORM t, int threads = 0)
+{
+    TileBlock dst;
+    if (transformSwapsAxes(t)) dst.Create(src.cols, src.rows);
+    else dst.Create(src.rows, src.cols);
+    if (src.empty()) return dst;
+
+    const std::size_t R = (std::size_t)src.rows, C = (std::size_t)src.cols;
+    switch (t)
+    {
+    case MAPTRANSFORM::FLIP_H:
+    case MAPTRANSFORM::FLIP_V:
+    case MAPTRANSFORM::ROTATE_180:
+        parallelFor(dst.rows, [&](int r0, int r1)
+        {
+            for (int i = r0; i < r1; i++)
+            {
+                const std::uint8_t* in = src.row(t == MAPTRANSFORM::FLIP_H ? i : (int)R - 1 - i);
+                if (t == MAPTRANSFORM::FLIP_V) std::memcpy(dst.row(i), in, C);
+                else std::reverse_copy(in, in + C, dst.row(i));
+            }
+        }, threads);
+        break;
+    case MAPTRANSFORM::ROTATE_CW:
+        // The bottom left source tile ends up top left
+        transformBlocked(src, dst, [R, C](std::size_t i, std::size_t j) { return (R - 1 - j) * C + i; }, threads);
+        break;
+    case MAPTRANSFORM::ROTATE_CCW:
+        // The top right source tile ends up top left
+        transformBlocked(src, dst, [C](std::size_t i, std::size_t j) { return j * C + (C - 1 - i); }, threads);
+        break;
+    case MAPTRANSFORM::TRANSPOSE:
+        transformBlocked(src, dst, [C](std::size_t i, std::size_t j) { return j * C + i; }, threads);
+        break;
+    }
+    return dst;
+}
+
+// Fills out with (r, c) and its mirror images in a rows x cols map, without duplicates
+// (tiles on an axis mirror onto themselves). Returns how many points were written.
+inline int mirroredPoints(int r, int c, int rows, int cols, SYMMETRY s, std::array<std::array<int, 2>, 4>& out)
+{
+    int n = 0;
+    auto add = [&](int pr, int pc)
+    {
+        for (int k = 0; k < n; k++)
+        {
+            if (out[k][0] == pr && out[k][1] == pc) return;
+        }
+        out[n++] = { pr, pc };
+    };
+    bool h = s == SYMMETRY::HORIZONTAL || s == SYMMETRY::BOTH;
+    bool v = s == SYMMETRY::VERTICAL || s == SYMMETRY::BOTH;
+    add(r, c);
+    if (h) add(r, cols - 1 - c);
+    if (v) add(rows - 1 - r, c);
+    if (h && v) add(rows - 1 - r, cols - 1 - c);
+    return n;
+}
@@ -0,0 +1,286 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ParallelFor.h"
+#include "TileBlock.h"
+#include "TileTypeDefinitions.h"
+
+// Seeded Pac-Man maze generator.
+//
+// Corridors run through a grid of cells at odd (row, col) tiles with one-tile walls
+// in between. Only the left half is generated, the right half is its mirror image.
+// The maze is cut into horizontal bands of MazeSettings::bandCells cell rows that are
+// generated independently (and in parallel):
+//   - a random spanning tree (depth first) over the band's cells,
+//   - openings through the wall row above the band, picked by hashing (seed, border, column)
+//     so the band on either side knows them without talking to the other,
+//   - openings through the centre column if the halves do not share a middle cell column,
+//   - dead ends braided away (opened into a neighbour), Pac-Man mazes have none.
+// Every band is connected and joined to its neighbours, so the whole maze is.
+// A ghost house with four ghost spawns sits in the middle, surrounded by a free ring,
+// with the player spawn below it, and every other walkable tile gets a coin.
+//
+// Everything random comes from (seed, band) so the output is identical for any thread count.
+// Even sizes keep their last row/column as wall so the mirror stays exact.
+
+const int MAZE_MIN_ROWS = 11;
+const int MAZE_MIN_COLS = 15;
+// One border/centre opening per this many cells
+const int MAZE_OPENING_SPACING = 16;
+
+struct MazeSettings
+{
+    int rows = 0, cols = 0;
+    std::uint64_t seed = 1;
+    // Cell rows per band (the unit of parallel work)
+    int bandCells = 64;
+    // Worker threads (0 = one per core)
+    int threads = 0;
+};
+
+// splitmix64, also used to hash (seed, a, b) into a stream start
+inline std::uint64_t mazeMix(std::uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+inline std::uint64_t mazeHash(std::uint64_t seed, std::uint64_t a, std::uint64_t b)
+{
+    return mazeMix(mazeMix(mazeMix(seed) ^ a) ^ b);
+}
+
+struct MazeRng
+{
+    std::uint64_t state;
+    explicit MazeRng(std::uint64_t seed) : state(seed) {}
+    std::uint64_t next() { return mazeMix(state++); }
+    // [0, n)
+    int below(int n) { return (int)(next() % (std::uint64_t)n); }
+};
+
+class MazeGenerator
+{
+private:
+    MazeSettings settings;
+    // Used area (odd sizes), cell grid and its generated left half
+    int usedRows = 0, usedCols = 0;
+    int cellRows = 0, cellCols = 0, leftCells = 0;
+    // Middle cell column is shared by both halves (cellCols odd)
+    bool sharedMiddle = false;
+    int centerCol = 0, centerRow = 0;
+
+    static const std::uint8_t WALL = (std::uint8_t)TILETYPE::WALL;
+    static const std::uint8_t BLANK = (std::uint8_t)TILETYPE::BLANK;
+
+    int bandCount() const { return (cellRows + settings.bandCells - 1) / settings.bandCells; }
+    int bandFirstCell(int band) const { return band * settings.bandCells; }
+    int bandEndCell(int band) const { return std::min(cellRows, (band + 1) * settings.bandCells); }
+
+    // Opened cell column of one MAZE_OPENING_SPACING wide segment in the wall row above band `border` (>= 1)
+    int borderOpening(int border, int segment) const
+    {
+        int first = segment * MAZE_OPENING_SPACING;
+        int n = std::min(MAZE_OPENING_SPACING, leftCells - first);
+        return first + (int)(mazeHash(settings.seed, 0x100000000ull + (std::uint64_t)border, (std::uint64_t)segment) % (std::uint64_t)n);
+    }
+
+    bool isBorderOpen(int border, int cellCol) const
+    {
+        if (border <= 0 || border >= bandCount()) return false;
+        return borderOpening(border, cellCol / MAZE_OPENING_SPACING) == cellCol;
+    }
+
+    // Same for the centre wall column, per segment of cell rows
+    int centerOpening(int segment) const
+    {
+        int first = segment * MAZE_OPENING_SPACING;
+        int n = std::min(MAZE_OPENING_SPACING, cellRows - first);
+        return first + (int)(mazeHash(settings.seed, 0x200000000ull, (std::uint64_t)segment) % (std::uint64_t)n);
+    }
+
+    // Tiles of band `band`: the wall row above its first cell row down to the next band's wall row
+    int bandFirstRow(int band) const { return 2 * bandFirstCell(band); }
+    int bandEndRow(int band) const { return band == bandCount() - 1 ? settings.rows : 2 * bandEndCell(band); }
+
+    // Number of open sides of cell (i, j), band is the block holding tile rows from r0
+    int openSides(const TileBlock& block, int r0, int band, int i, int j) const
+    {
+        int r = 2 * i + 1 - r0, c = 2 * j + 1;
+        int n = 0;
+        // Up: inside the band or the band's own top border row
+        if (block.get(r - 1, c) == BLANK) n++;
+        // Down: the next band owns that row
+        if (i + 1 < bandEndCell(band)) n += block.get(r + 1, c) == BLANK;
+        else n += isBorderOpen(band + 1, j);
+        if (j > 0 && block.get(r, c - 1) == BLANK) n++;
+        if (j + 1 < leftCells || !sharedMiddle)
+        {
+            if (c + 1 < usedCols - 1 && block.get(r, c + 1) == BLANK) n++;
+        }
+        // The shared middle column's right side mirrors its left side
+        else if (j > 0 && block.get(r, c - 1) == BLANK) n++;
+        return n;
+    }
+
+    void generateBand(int band, TileBlock& block) const
+    {
+        int r0 = bandFirstRow(band);
+        block.Create(bandEndRow(band) - r0, settings.cols, WALL);
+        int i0 = bandFirstCell(band), i1 = bandEndCell(band);
+        int bandRows = i1 - i0;
+        MazeRng rng(mazeHash(settings.seed, 0x300000000ull, (std::uint64_t)band));
+
+        // Depth first spanning tree over the left half cells of the band
+        std::vector<std::uint8_t> visited((std::size_t)bandRows * leftCells, 0);
+        std::vector<int> stack;
+        int start = rng.below(bandRows * leftCells);
+        visited[start] = 1;
+        stack.push_back(start);
+        block.set(2 * (i0 + start / leftCells) + 1 - r0, 2 * (start % leftCells) + 1, BLANK);
+        const int di[4] = { -1, 1, 0, 0 };
+        const int dj[4] = { 0, 0, -1, 1 };
+        while (!stack.empty())
+        {
+            int cell = stack.back();
+            int li = cell / leftCells, j = cell % leftCells;
+            int options[4], count = 0;
+            for (int d = 0; d < 4; d++)
+            {
+                int ni = li + di[d], nj = j + dj[d];
+                if (ni < 0 || ni >= bandRows || nj < 0 || nj >= leftCells) continue;
+                if (!visited[(std::size_t)ni * leftCells + nj]) options[count++] = d;
+            }
+            if (count == 0)
+            {
+                stack.pop_back();
+                continue;
+            }
+            int d = options[rng.below(count)];
+            int ni = li + di[d], nj = j + dj[d];
+            int r = 2 * (i0 + li) + 1 - r0, c = 2 * j + 1;
+            block.set(r + di[d], c + dj[d], BLANK);
+            block.set(r + 2 * di[d], c + 2 * dj[d], BLANK);
+            visited[(std::size_t)ni * leftCells + nj] = 1;
+            stack.push_back(ni * leftCells + nj);
+        }
+
+        // Openings up into the previous band
+        if (band > 0)
+        {
+            for (int s = 0; s * MAZE_OPENING_SPACING < leftCells; s++) block.set(0, 2 * borderOpening(band, s) + 1, BLANK);
+        }
+        // Openings through the centre wall column between the two halves
+        if (!sharedMiddle)
+        {
+            for (int s = 0; s * MAZE_OPENING_SPACING < cellRows; s++)
+            {
+                int i = centerOpening(s);
+                if (i >= i0 && i < i1) block.set(2 * i + 1 - r0, centerCol, BLANK);
+            }
+        }
+
+        // Braid: open every dead end into a random closed neighbour in the band (or up
+        // through the band's own border row, a one row band has no other way out of a corner)
+        for (int i = i0; i < i1; i++)
+        {
+            for (int j = 0; j < leftCells; j++)
+            {
+                if (openSides(block, r0, band, i, j) > 1) continue;
+                int r = 2 * i + 1 - r0, c = 2 * j + 1;
+                int options[4], count = 0;
+                if ((i > i0 || band > 0) && block.get(r - 1, c) == WALL) options[count++] = 0;
+                if (i + 1 < i1 && block.get(r + 1, c) == WALL) options[count++] = 1;
+                if (j > 0 && block.get(r, c - 1) == WALL) options[count++] = 2;
+                if ((j + 1 < leftCells || !sharedMiddle) && block.get(r, c + 1) == WALL) options[count++] = 3;
+                if (count == 0) continue;
+                int d = options[rng.below(count)];
+                block.set(r + di[d], c + dj[d], BLANK);
+            }
+        }
+
+        // Mirror the left half onto the right
+        for (int r = 0; r < block.rows; r++)
+        {
+            std::uint8_t* row = block.row(r);
+            for (int c = 0; c < usedCols / 2; c++) row[usedCols - 1 - c] = row[c];
+        }
+
+        decorate(block, r0);
+    }
+
+    // Ghost house, its ring, the player spawn and coins, all by tile position
+    void decorate(TileBlock& block, int r0) const
+    {
+        for (int r = 0; r < block.rows; r++)
+        {
+            int dr = r0 + r - centerRow;
+            std::uint8_t* row = block.row(r);
+            for (int c = 0; c < usedCols; c++)
+            {
+                int dc = c - centerCol;
+                int adr = dr < 0 ? -dr : dr, adc = dc < 0 ? -dc : dc;
+                if (adr <= 3 && adc <= 5)
+                {
+                    // Box walls 9x5 with a door on top, free ring around it
+                    if (adr == 3 || adc == 5) row[c] = dr == 3 && dc == 0 ? (std::uint8_t)TILETYPE::PLAYERSPAWN : BLANK;
+                    else if (adr == 2 || adc == 4) row[c] = (dr == -2 && dc == 0) ? BLANK : WALL;
+                    else row[c] = (dr == 0 && (adc == 1 || adc == 3)) ? (std::uint8_t)TILETYPE::GHOSTSPAWN : BLANK;
+                }
+                else if (row[c] == BLANK) row[c] = (std::uint8_t)TILETYPE::COIN;
+            }
+        }
+    }
+
+public:
+    explicit MazeGenerator(const MazeSettings& _settings) : settings(_settings)
+    {
+        if (settings.rows < MAZE_MIN_ROWS || settings.cols < MAZE_MIN_COLS)
+            throw std::runtime_error("Maze error: mazes must be at least " + std::to_string(MAZE_MIN_ROWS) + "x" + std::to_string(MAZE_MIN_COLS));
+        if (settings.bandCells < 2) settings.bandCells = 2;
+        usedRows = settings.rows - (settings.rows % 2 == 0);
+        usedCols = settings.cols - (settings.cols % 2 == 0);
+        cellRows = (usedRows - 1) / 2;
+        cellCols = (usedCols - 1) / 2;
+        sharedMiddle = cellCols % 2 == 1;
+        leftCells = (cellCols + 1) / 2;
+        centerCol = (usedCols - 1) / 2;
+        centerRow = (usedRows - 1) / 2;
+    }
+
+    // Generates the maze and calls emit(firstRow, band) for every band, top to bottom.
+    // Bands are made a batch at a time on the worker threads, emit runs on the calling thread.
+    void Generate(const std::function<void(int, const TileBlock&)>& emit) const
+    {
+        int bands = bandCount();
+        int batch = workerCount(settings.threads) * 2;
+        std::vector<TileBlock> blocks(batch);
+        for (int first = 0; first < bands; first += batch)
+        {
+            int n = std::min(batch, bands - first);
+            parallelFor(n, [&](int begin, int end)
+            {
+                for (int b = begin; b < end; b++) generateBand(first + b, blocks[b]);
+            }, settings.threads);
+            for (int b = 0; b < n; b++) emit(bandFirstRow(first + b), blocks[b]);
+        }
+    }
+
+    // Whole maze in one block
+    TileBlock GenerateBlock() const
+    {
+        TileBlock maze;
+        maze.Create(settings.rows, settings.cols, WALL);
+        Generate([&maze](int r0, const TileBlock& band)
+        {
+            std::copy(band.tiles.begin(), band.tiles.end(), maze.tiles.begin() + (std::size_t)r0 * maze.cols);
+        });
+        return maze;
+    }
+};
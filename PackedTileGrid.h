@@ -0,0 +1,162 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Compressed in-memory tile grid.
+//
+// Tiles are bit-packed (BITS bits per tile) inside 64x64 blocks. Blocks that were
+// never written with a non-zero (non BLANK) tile are not allocated at all, so
+// mostly-empty maps cost close to nothing and dense maps cost BITS bits per tile
+// instead of a pointer plus a Tile object.
+//
+// get/set are O(1), readRow decodes a whole row span block by block.
+
+const int PACKED_BLOCK_SIZE = 64;
+
+template <int BITS>
+class PackedTileGridT
+{
+    static_assert(BITS == 1 || BITS == 2 || BITS == 4 || BITS == 8, "BITS must divide 64");
+
+private:
+    static const int TILES_PER_WORD = 64 / BITS;
+    static const int WORDS_PER_ROW = PACKED_BLOCK_SIZE / TILES_PER_WORD;
+    static const int WORDS_PER_BLOCK = WORDS_PER_ROW * PACKED_BLOCK_SIZE;
+    static constexpr std::uint64_t MASK = (BITS == 64) ? ~0ull : ((1ull << BITS) - 1);
+
+    std::vector<std::unique_ptr<std::uint64_t[]>> blocks;
+    std::size_t allocatedBlocks = 0;
+
+    std::uint64_t* blockAt(int r, int c) const
+    {
+        return blocks[(std::size_t)(r / PACKED_BLOCK_SIZE) * blocksX + (c / PACKED_BLOCK_SIZE)].get();
+    }
+
+    static void setInRow(std::uint64_t* rowWords, int lc, std::uint8_t t)
+    {
+        std::uint64_t& word = rowWords[lc / TILES_PER_WORD];
+        int shift = (lc % TILES_PER_WORD) * BITS;
+        word = (word & ~(MASK << shift)) | ((std::uint64_t)(t & MASK) << shift);
+    }
+
+public:
+    int rows = 0, cols = 0;
+    int blocksX = 0, blocksY = 0;
+
+    void Create(int _rows, int _cols)
+    {
+        rows = _rows;
+        cols = _cols;
+        blocksX = (cols + PACKED_BLOCK_SIZE - 1) / PACKED_BLOCK_SIZE;
+        blocksY = (rows + PACKED_BLOCK_SIZE - 1) / PACKED_BLOCK_SIZE;
+        blocks.clear();
+        blocks.resize((std::size_t)blocksX * blocksY);
+        allocatedBlocks = 0;
+    }
+
+    void Clear()
+    {
+        blocks.clear();
+        blocks.shrink_to_fit();
+        allocatedBlocks = 0;
+        rows = cols = blocksX = blocksY = 0;
+    }
+
+    std::uint8_t get(int r, int c) const
+    {
+        const std::uint64_t* block = blockAt(r, c);
+        if (block == nullptr) return 0;
+        int lc = c % PACKED_BLOCK_SIZE;
+        std::uint64_t word = block[(r % PACKED_BLOCK_SIZE) * WORDS_PER_ROW + lc / TILES_PER_WORD];
+        return (std::uint8_t)((word >> ((lc % TILES_PER_WORD) * BITS)) & MASK);
+    }
+
+    void set(int r, int c, std::uint8_t t)
+    {
+        std::unique_ptr<std::uint64_t[]>& block = blocks[(std::size_t)(r / PACKED_BLOCK_SIZE) * blocksX + (c / PACKED_BLOCK_SIZE)];
+        if (!block)
+        {
+            // Writing blank into a blank block changes nothing
+            if (t == 0) return;
+            block.reset(new std::uint64_t[WORDS_PER_BLOCK]());
+            allocatedBlocks++;
+        }
+        setInRow(block.get() + (r % PACKED_BLOCK_SIZE) * WORDS_PER_ROW, c % PACKED_BLOCK_SIZE, t);
+    }
+
+    // Decodes tiles [c0, c0 + n) of row r into out
+    void readRow(int r, int c0, int n, std::uint8_t* out) const
+    {
+        int c = c0;
+        int end = c0 + n;
+        while (c < end)
+        {
+            int blockEnd = std::min(end, (c / PACKED_BLOCK_SIZE + 1) * PACKED_BLOCK_SIZE);
+            const std::uint64_t* block = blockAt(r, c);
+            if (block == nullptr)
+            {
+                std::memset(out + (c - c0), 0, blockEnd - c);
+            }
+            else
+            {
+                const std::uint64_t* rowWords = block + (r % PACKED_BLOCK_SIZE) * WORDS_PER_ROW;
+                for (int x = c; x < blockEnd; x++)
+                {
+                    int lc = x % PACKED_BLOCK_SIZE;
+                    out[x - c0] = (std::uint8_t)((rowWords[lc / TILES_PER_WORD] >> ((lc % TILES_PER_WORD) * BITS)) & MASK);
+                }
+            }
+            c = blockEnd;
+        }
+    }
+
+    // Encodes tiles [c0, c0 + n) of row r from in, a whole word at a time where possible
+    void writeRow(int r, int c0, int n, const std::uint8_t* in)
+    {
+        int c = c0;
+        int end = c0 + n;
+        while (c < end)
+        {
+            int blockEnd = std::min(end, (c / PACKED_BLOCK_SIZE + 1) * PACKED_BLOCK_SIZE);
+            std::unique_ptr<std::uint64_t[]>& block = blocks[(std::size_t)(r / PACKED_BLOCK_SIZE) * blocksX + (c / PACKED_BLOCK_SIZE)];
+            if (!block)
+            {
+                // Blank spans into blank blocks change nothing
+                bool blank = true;
+                for (int x = c; x < blockEnd && blank; x++) blank = in[x - c0] == 0;
+                if (blank)
+                {
+                    c = blockEnd;
+                    continue;
+                }
+                block.reset(new std::uint64_t[WORDS_PER_BLOCK]());
+                allocatedBlocks++;
+            }
+
+            std::uint64_t* rowWords = block.get() + (r % PACKED_BLOCK_SIZE) * WORDS_PER_ROW;
+            int x = c;
+            for (; x < blockEnd && x % TILES_PER_WORD != 0; x++) setInRow(rowWords, x % PACKED_BLOCK_SIZE, in[x - c0]);
+            for (; x + TILES_PER_WORD <= blockEnd; x += TILES_PER_WORD)
+            {
+                std::uint64_t word = 0;
+                const std::uint8_t* src = in + (x - c0);
+                for (int k = 0; k < TILES_PER_WORD; k++) word |= (std::uint64_t)(src[k] & MASK) << (k * BITS);
+                rowWords[(x % PACKED_BLOCK_SIZE) / TILES_PER_WORD] = word;
+            }
+            for (; x < blockEnd; x++) setInRow(rowWords, x % PACKED_BLOCK_SIZE, in[x - c0]);
+            c = blockEnd;
+        }
+    }
+
+    std::size_t blockCount() const { return blocks.size(); }
+    std::size_t allocatedBlockCount() const { return allocatedBlocks; }
+
+    // Bytes used by the block table and the allocated blocks
+    std::size_t memoryBytes() const
+    {
+        return blocks.capacity() * sizeof(blocks[0]) + allocatedBlocks * WORDS_PER_BLOCK * sizeof(std::uint64_t);
+    }
+};
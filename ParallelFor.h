@@ -0,0 +1,103 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads to use for bulk jobs (0 = one per core)
+inline int workerCount(int requested = 0)
+{
+    if (requested > 0) return requested;
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : (int)n;
+}
+
+// Splits [0, count) into one contiguous range per worker and runs fn(begin, end) on each.
+// The calling thread takes the first range. Returns when every range is done.
+inline void parallelFor(int count, const std::function<void(int, int)>& fn, int threads = 0)
+{
+    if (count <= 0) return;
+    threads = std::min(workerCount(threads), count);
+    if (threads == 1)
+    {
+        fn(0, count);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (int t = 1; t < threads; t++)
+    {
+        int begin = (int)((long long)count * t / threads);
+        int end = (int)((long long)count * (t + 1) / threads);
+        workers.emplace_back(fn, begin, end);
+    }
+    fn(0, (int)((long long)count / threads));
+    for (std::thread& w : workers) w.join();
+}
+
+// Long lived worker threads for a stream of small independent jobs (unlike parallelFor,
+// Submit returns at once). Jobs still queued when the pool stops are dropped.
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> jobs;
+    bool stopping = false;
+
+    void run()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+public:
+    ~ThreadPool() { Stop(); }
+
+    bool isRunning() const { return !workers.empty(); }
+
+    void Start(int threads = 0)
+    {
+        Stop();
+        stopping = false;
+        for (int t = 0; t < workerCount(threads); t++) workers.emplace_back(&ThreadPool::run, this);
+    }
+
+    // Waits for running jobs, drops queued ones
+    void Stop()
+    {
+        if (workers.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            jobs.clear();
+        }
+        cv.notify_all();
+        for (std::thread& w : workers) w.join();
+        workers.clear();
+    }
+
+    void Submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        cv.notify_one();
+    }
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Many small images packed into one texture, so everything that uses them can be
+// drawn with a single VertexArray and one texture bind.
+//
+// Images are packed left to right in shelves (rows) as wide as the widest image or
+// ATLAS_WIDTH, whichever is bigger, with a transparent gap between them.
+
+const unsigned ATLAS_WIDTH = 512;
+const unsigned ATLAS_PADDING = 1;
+
+class TextureAtlas
+{
+public:
+    sf::Texture texture;
+    // Where each image ended up, in the order they were given
+    std::vector<sf::IntRect> rects;
+
+    bool Build(const std::vector<sf::Image>& images)
+    {
+        rects.clear();
+        unsigned width = ATLAS_WIDTH;
+        for (const sf::Image& image : images) width = std::max(width, image.getSize().x);
+
+        // Shelf packing
+        unsigned x = 0, y = 0, shelfHeight = 0;
+        for (const sf::Image& image : images)
+        {
+            sf::Vector2u size = image.getSize();
+            if (x + size.x > width)
+            {
+                x = 0;
+                y += shelfHeight + ATLAS_PADDING;
+                shelfHeight = 0;
+            }
+            rects.push_back(sf::IntRect({ (int)x, (int)y }, { (int)size.x, (int)size.y }));
+            x += size.x + ATLAS_PADDING;
+            shelfHeight = std::max(shelfHeight, size.y);
+        }
+        unsigned height = std::max(1u, y + shelfHeight);
+        if (height > sf::Texture::getMaximumSize())
+        {
+            std::cout << "Error: atlas needs " << width << "x" << height << " pixels, more than the max texture size\n";
+            return false;
+        }
+
+        sf::Image atlas({ width, height }, sf::Color::Transparent);
+        for (std::size_t i = 0; i < images.size(); i++)
+        {
+            sf::Vector2u dest((unsigned)rects[i].position.x, (unsigned)rects[i].position.y);
+            if (!atlas.copy(images[i], dest)) std::cout << "Error: could not copy image " << i << " into the atlas\n";
+        }
+        return texture.loadFromImage(atlas);
+    }
+
+    // Loads every file (missing files become a 1x1 magenta placeholder) and packs them
+    bool BuildFromFiles(const std::vector<std::string>& paths)
+    {
+        std::vector<sf::Image> images;
+        for (const std::string& path : paths)
+        {
+            sf::Image image;
+            if (!image.loadFromFile(path))
+            {
+                std::cout << "Error: could not load texture: " << path << "\n";
+                image = sf::Image({ 1, 1 }, sf::Color::Magenta);
+            }
+            images.push_back(std::move(image));
+        }
+        return Build(images);
+    }
+
+    // Appends the two triangles of a quad showing image `index` at screen rect `bounds`
+    void AppendQuad(sf::VertexArray& vertices, int index, sf::FloatRect bounds, sf::Color color = sf::Color::White) const
+    {
+        const sf::IntRect& r = rects[index];
+        sf::Vector2f p0 = bounds.position;
+        sf::Vector2f p1 = bounds.position + bounds.size;
+        sf::Vector2f t0((float)r.position.x, (float)r.position.y);
+        sf::Vector2f t1((float)(r.position.x + r.size.x), (float)(r.position.y + r.size.y));
+
+        vertices.append({ p0, color, t0 });
+        vertices.append({ { p1.x, p0.y }, color, { t1.x, t0.y } });
+        vertices.append({ p1, color, t1 });
+        vertices.append({ p0, color, t0 });
+        vertices.append({ p1, color, t1 });
+        vertices.append({ { p0.x, p1.y }, color, { t0.x, t1.y } });
+    }
+};
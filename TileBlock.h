@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Dense rectangle of tile types, one byte per tile, row major.
+// Used as the clipboard and for moving whole regions in/out of a Map with row copies.
+struct TileBlock
+{
+    int rows = 0;
+    int cols = 0;
+    std::vector<std::uint8_t> tiles;
+
+    void Create(int _rows, int _cols, std::uint8_t fill = 0)
+    {
+        rows = _rows;
+        cols = _cols;
+        tiles.assign((std::size_t)rows * cols, fill);
+    }
+
+    bool empty() const { return rows == 0 || cols == 0; }
+
+    std::uint8_t* row(int r) { return tiles.data() + (std::size_t)r * cols; }
+    const std::uint8_t* row(int r) const { return tiles.data() + (std::size_t)r * cols; }
+
+    std::uint8_t get(int r, int c) const { return tiles[(std::size_t)r * cols + c]; }
+    void set(int r, int c, std::uint8_t t) { tiles[(std::size_t)r * cols + c] = t; }
+};
@@ -0,0 +1,310 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include "ParallelFor.h"
+#include "TextureAtlas.h"
+#include "TileBlock.h"
+#include "TileTypeDefinitions.h"
+
+// Tile geometry built on worker threads.
+//
+// The map is cut into square regions, the same CHUNK_SIZE regions Map keeps edit
+// revisions for. When a region's revision changes, the main thread copies its tiles
+// into a small TileBlock and queues a job. The job turns the tiles into a triangle
+// list (region-local pixels, UVs into the tile atlas) and into the region's pixels of
+// the minimap. Collect() swaps finished buffers in on the main thread. A region keeps
+// drawing its old vertices until then, so big rebuilds never stall a frame.
+
+// Vertex memory kept before regions that were not drawn recently are dropped
+const std::size_t MESH_MEMORY_BUDGET = 64u * 1024 * 1024;
+// Jobs in flight at once, so a whole-map rebuild does not flood the queue
+const int MESH_MAX_PENDING = 64;
+// Minimap texture limit, bigger maps get several tiles per minimap pixel
+const int MINIMAP_MAX_SIZE = 256;
+
+struct RegionMesh
+{
+    std::vector<sf::Vertex> vertices;
+    // Revision the vertices/minimap pixels were built from
+    std::uint32_t revision = 0;
+    std::uint32_t minimapRevision = 0;
+    // TileMeshCache::drawnAsVersion the vertices were built with
+    std::uint32_t drawnAsVersion = 0;
+    bool built = false;
+    bool minimapBuilt = false;
+    bool pending = false;
+    std::uint64_t lastDrawn = 0;
+};
+
+class TileMeshCache
+{
+private:
+    struct Result
+    {
+        int region;
+        std::uint32_t revision;
+        std::uint32_t drawnAsVersion;
+        bool mesh;
+        std::vector<sf::Vertex> vertices;
+        std::vector<std::uint8_t> pixels;
+        sf::Vector2u pixelSize;
+    };
+
+    int rows = 0, cols = 0, regionSize = 0;
+    int regionsX = 0, regionsY = 0;
+    std::vector<RegionMesh> regions;
+    std::uint64_t frame = 0;
+    int pendingJobs = 0;
+    std::size_t meshBytes = 0;
+    bool minimapCreated = false;
+    // Bumped by SetDrawnAs
+    std::uint32_t drawnAsVersion = 0;
+
+    // Copies for the workers, they never touch the Map or the textures
+    std::vector<sf::IntRect> atlasRects;
+    std::vector<sf::IntRect> tileRects;
+    std::vector<sf::Color> tileColors;
+    const sf::Texture* atlasTexture = nullptr;
+
+    std::mutex doneMutex;
+    std::vector<Result> done;
+    std::vector<Result> collecting;
+
+    // Declared last so it stops before anything its jobs use is destroyed
+    ThreadPool pool;
+
+    static std::vector<sf::Vertex> buildVertices(const TileBlock& tiles, const std::vector<sf::IntRect>& rects, float tileSize)
+    {
+        std::vector<sf::Vertex> vertices;
+        vertices.reserve((std::size_t)tiles.rows * tiles.cols * 6);
+        for (int i = 0; i < tiles.rows; i++)
+        {
+            const std::uint8_t* row = tiles.row(i);
+            for (int j = 0; j < tiles.cols; j++)
+            {
+                const sf::IntRect& r = rects[row[j]];
+                sf::Vector2f p0(j * tileSize, i * tileSize);
+                sf::Vector2f p1 = p0 + sf::Vector2f(tileSize, tileSize);
+                sf::Vector2f t0((float)r.position.x, (float)r.position.y);
+                sf::Vector2f t1((float)(r.position.x + r.size.x), (float)(r.position.y + r.size.y));
+                vertices.push_back({ p0, sf::Color::White, t0 });
+                vertices.push_back({ { p1.x, p0.y }, sf::Color::White, { t1.x, t0.y } });
+                vertices.push_back({ p1, sf::Color::White, t1 });
+                vertices.push_back({ p0, sf::Color::White, t0 });
+                vertices.push_back({ p1, sf::Color::White, t1 });
+                vertices.push_back({ { p0.x, p1.y }, sf::Color::White, { t0.x, t1.y } });
+            }
+        }
+        return vertices;
+    }
+
+    // One pixel per step x step tiles (the top left one), RGBA
+    static std::vector<std::uint8_t> buildMinimapPixels(const TileBlock& tiles, const std::vector<sf::Color>& colors, int step, sf::Vector2u& size)
+    {
+        size = sf::Vector2u((unsigned)((tiles.cols + step - 1) / step), (unsigned)((tiles.rows + step - 1) / step));
+        std::vector<std::uint8_t> pixels((std::size_t)size.x * size.y * 4);
+        std::uint8_t* out = pixels.data();
+        for (int i = 0; i < tiles.rows; i += step)
+        {
+            const std::uint8_t* row = tiles.row(i);
+            for (int j = 0; j < tiles.cols; j += step)
+            {
+                sf::Color c = colors[row[j]];
+                *out++ = c.r;
+                *out++ = c.g;
+                *out++ = c.b;
+                *out++ = c.a;
+            }
+        }
+        return pixels;
+    }
+
+public:
+    // Tiles per minimap pixel (a power of two so regions map to whole pixels)
+    int minimapStep = 1;
+    bool minimapEnabled = false;
+    sf::Texture minimap;
+
+    ~TileMeshCache() { pool.Stop(); }
+
+    // Atlas and per-type colours (the atlas texture must outlive the cache)
+    void SetTiles(const TextureAtlas& atlas, const std::vector<sf::Color>& colors)
+    {
+        pool.Stop();
+        atlasRects = atlas.rects;
+        tileRects = atlas.rects;
+        tileColors = colors;
+        atlasTexture = &atlas.texture;
+    }
+
+    // Draws tiles of type t with the image of type drawnAs[t] (PLAY mode hides the tiles
+    // entities stand in for). Regions keep their old vertices until rebuilt, the minimap
+    // keeps the real types.
+    void SetDrawnAs(const std::vector<std::uint8_t>& drawnAs)
+    {
+        // No job may read tileRects while they change. Dropped jobs are queued again through needsMesh.
+        pool.Stop();
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            done.clear();
+        }
+        for (RegionMesh& r : regions) r.pending = false;
+        pendingJobs = 0;
+        for (std::size_t t = 0; t < tileRects.size() && t < drawnAs.size(); t++) tileRects[t] = atlasRects[drawnAs[t]];
+        drawnAsVersion++;
+    }
+
+    bool hasTiles() const { return atlasTexture != nullptr; }
+
+    // Forgets every region (new map), queued jobs for the old one are dropped
+    void Reset(int _rows, int _cols, int _regionSize, bool withMinimap)
+    {
+        pool.Stop();
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            done.clear();
+        }
+        rows = _rows;
+        cols = _cols;
+        regionSize = _regionSize;
+        regionsX = (cols + regionSize - 1) / regionSize;
+        regionsY = (rows + regionSize - 1) / regionSize;
+        regions.clear();
+        regions.resize((std::size_t)regionsX * regionsY);
+        pendingJobs = 0;
+        meshBytes = 0;
+
+        minimapEnabled = withMinimap;
+        minimapCreated = false;
+        minimapStep = 1;
+        while (std::max(rows, cols) / minimapStep > MINIMAP_MAX_SIZE && minimapStep < regionSize) minimapStep *= 2;
+    }
+
+    int getRegionsX() const { return regionsX; }
+    int getRegionsY() const { return regionsY; }
+    int regionCount() const { return (int)regions.size(); }
+    int getPendingJobs() const { return pendingJobs; }
+    std::size_t getMeshBytes() const { return meshBytes; }
+    bool isMinimapReady() const { return minimapCreated; }
+
+    bool canSubmit() const { return pendingJobs < MESH_MAX_PENDING; }
+
+    bool needsMesh(int id, std::uint32_t revision) const
+    {
+        const RegionMesh& r = regions[id];
+        return !r.pending && (!r.built || r.revision != revision || r.drawnAsVersion != drawnAsVersion);
+    }
+
+    bool needsMinimap(int id, std::uint32_t revision) const
+    {
+        const RegionMesh& r = regions[id];
+        return minimapEnabled && !r.pending && (!r.minimapBuilt || r.minimapRevision != revision);
+    }
+
+    // Queues a rebuild of region id from a copy of its tiles. Without mesh only the minimap pixels are made.
+    void Submit(int id, std::uint32_t revision, bool mesh, TileBlock tiles)
+    {
+        if (!pool.isRunning()) pool.Start();
+        regions[id].pending = true;
+        pendingJobs++;
+        bool minimapToo = minimapEnabled;
+        int step = minimapStep;
+        std::uint32_t version = drawnAsVersion;
+        pool.Submit([this, id, revision, version, mesh, minimapToo, step, tiles = std::move(tiles)]()
+        {
+            Result result;
+            result.region = id;
+            result.revision = revision;
+            result.drawnAsVersion = version;
+            result.mesh = mesh;
+            if (mesh) result.vertices = buildVertices(tiles, tileRects, (float)TILE_SIZE);
+            if (minimapToo) result.pixels = buildMinimapPixels(tiles, tileColors, step, result.pixelSize);
+            std::lock_guard<std::mutex> lock(doneMutex);
+            done.push_back(std::move(result));
+        });
+    }
+
+    // Main thread: swaps finished buffers in. Returns how many regions changed.
+    int Collect()
+    {
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            collecting.swap(done);
+        }
+        for (Result& result : collecting)
+        {
+            RegionMesh& r = regions[result.region];
+            r.pending = false;
+            pendingJobs--;
+            if (result.mesh)
+            {
+                meshBytes -= r.vertices.capacity() * sizeof(sf::Vertex);
+                r.vertices.swap(result.vertices);
+                meshBytes += r.vertices.capacity() * sizeof(sf::Vertex);
+                r.revision = result.revision;
+                r.drawnAsVersion = result.drawnAsVersion;
+                r.built = true;
+            }
+            if (!result.pixels.empty())
+            {
+                if (!minimapCreated)
+                {
+                    sf::Vector2u size((unsigned)((cols + minimapStep - 1) / minimapStep), (unsigned)((rows + minimapStep - 1) / minimapStep));
+                    if (!minimap.resize(size)) std::cout << "Error: could not create the minimap texture\n";
+                    minimapCreated = true;
+                }
+                int rx = result.region % regionsX, ry = result.region / regionsX;
+                sf::Vector2u dest((unsigned)(rx * regionSize / minimapStep), (unsigned)(ry * regionSize / minimapStep));
+                minimap.update(result.pixels.data(), result.pixelSize, dest);
+                r.minimapRevision = result.revision;
+                r.minimapBuilt = true;
+            }
+        }
+        int count = (int)collecting.size();
+        collecting.clear();
+        return count;
+    }
+
+    // Draws the built regions in [rx0, rx1) x [ry0, ry1). world maps map pixels to the screen.
+    void Draw(sf::RenderTarget& target, const sf::Transform& world, int rx0, int ry0, int rx1, int ry1)
+    {
+        frame++;
+        sf::RenderStates states(atlasTexture);
+        for (int ry = ry0; ry < ry1; ry++)
+        {
+            for (int rx = rx0; rx < rx1; rx++)
+            {
+                RegionMesh& r = regions[(std::size_t)ry * regionsX + rx];
+                if (!r.built || r.vertices.empty()) continue;
+                r.lastDrawn = frame;
+                states.transform = world;
+                states.transform.translate(sf::Vector2f((float)(rx * regionSize * TILE_SIZE), (float)(ry * regionSize * TILE_SIZE)));
+                target.draw(r.vertices.data(), r.vertices.size(), sf::PrimitiveType::Triangles, states);
+            }
+        }
+        if (meshBytes > MESH_MEMORY_BUDGET) Trim();
+    }
+
+    // Drops the meshes drawn longest ago until under budget (they are rebuilt when seen again)
+    void Trim()
+    {
+        std::vector<int> built;
+        for (int id = 0; id < (int)regions.size(); id++)
+        {
+            if (regions[id].built && regions[id].lastDrawn != frame) built.push_back(id);
+        }
+        std::sort(built.begin(), built.end(), [this](int a, int b) { return regions[a].lastDrawn < regions[b].lastDrawn; });
+        for (int id : built)
+        {
+            if (meshBytes <= MESH_MEMORY_BUDGET / 2) break;
+            RegionMesh& r = regions[id];
+            meshBytes -= r.vertices.capacity() * sizeof(sf::Vertex);
+            std::vector<sf::Vertex>().swap(r.vertices);
+            r.built = false;
+        }
+    }
+};
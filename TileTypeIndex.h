@@ -0,0 +1,118 @@
+#pragma once
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include "MapExport.h"
+
+// Where every tile of each type is, kept up to date edit by edit.
+//
+// Each type has an unordered list of positions (row * cols + col). slot[pos] is the
+// position's place in its type's list, so moving a tile to another type is a
+// swap-remove plus a push_back: O(1). Counts are the list sizes, enumerating a type is
+// O(tiles of that type). BLANK is not stored (it is everything else), only counted.
+//
+// The index costs 4 bytes per tile plus 4 per non-blank tile, so maps bigger than
+// TYPE_INDEX_MAX_TILES are not indexed and callers fall back to scanning. 16M tiles
+// (64 MB of slots) is as big as in-memory maps get, paged maps are never indexed.
+
+const std::uint64_t TYPE_INDEX_MAX_TILES = 1ull << 24;
+
+class TileTypeIndex
+{
+private:
+    int rows = 0, cols = 0;
+    bool built = false;
+    std::vector<std::vector<std::uint32_t>> positions;
+    std::vector<std::uint32_t> slot;
+
+    void add(std::uint32_t pos, std::uint8_t t)
+    {
+        if (t == 0) return;
+        std::vector<std::uint32_t>& list = positions[t];
+        slot[pos] = (std::uint32_t)list.size();
+        list.push_back(pos);
+    }
+
+    void remove(std::uint32_t pos, std::uint8_t t)
+    {
+        if (t == 0) return;
+        std::vector<std::uint32_t>& list = positions[t];
+        std::uint32_t i = slot[pos];
+        assert(i < list.size() && list[i] == pos);
+        std::uint32_t moved = list.back();
+        list[i] = moved;
+        slot[moved] = i;
+        list.pop_back();
+    }
+
+public:
+    static bool fits(int _rows, int _cols) { return (std::uint64_t)_rows * _cols <= TYPE_INDEX_MAX_TILES; }
+
+    bool isBuilt() const { return built; }
+
+    void Clear()
+    {
+        built = false;
+        rows = cols = 0;
+        positions.clear();
+        std::vector<std::uint32_t>().swap(slot);
+    }
+
+    // Indexes every tile, read one row at a time. typeCount is the number of tile types.
+    void Build(int _rows, int _cols, int typeCount, const MapRowReader& readRow)
+    {
+        Clear();
+        rows = _rows;
+        cols = _cols;
+        positions.assign(typeCount, {});
+        slot.assign((std::size_t)rows * cols, 0);
+        std::vector<std::uint8_t> row(cols);
+        for (int r = 0; r < rows; r++)
+        {
+            readRow(r, row.data());
+            std::uint32_t pos = (std::uint32_t)r * cols;
+            for (int c = 0; c < cols; c++, pos++) add(pos, row[c]);
+        }
+        built = true;
+    }
+
+    // Tile (r, c) changed from oldType to newType
+    void Set(int r, int c, std::uint8_t oldType, std::uint8_t newType)
+    {
+        if (!built || oldType == newType) return;
+        std::uint32_t pos = (std::uint32_t)r * cols + c;
+        remove(pos, oldType);
+        add(pos, newType);
+    }
+
+    // Tiles (r, c0 .. c0 + n - 1) changed from oldRow to newRow
+    void SetRow(int r, int c0, int n, const std::uint8_t* oldRow, const std::uint8_t* newRow)
+    {
+        for (int j = 0; j < n; j++) Set(r, c0 + j, oldRow[j], newRow[j]);
+    }
+
+    std::uint64_t count(std::uint8_t t) const
+    {
+        if (t != 0) return positions[t].size();
+        std::uint64_t blank = (std::uint64_t)rows * cols;
+        for (const std::vector<std::uint32_t>& list : positions) blank -= list.size();
+        return blank;
+    }
+
+    // Positions (row * cols + col) of every tile of type t, in no particular order. Not for BLANK.
+    const std::vector<std::uint32_t>& get(std::uint8_t t) const
+    {
+        assert(t != 0);
+        return positions[t];
+    }
+
+    std::array<int, 2> toRowCol(std::uint32_t pos) const { return { (int)(pos / cols), (int)(pos % cols) }; }
+
+    std::size_t memoryBytes() const
+    {
+        std::size_t bytes = slot.capacity() * sizeof(std::uint32_t);
+        for (const std::vector<std::uint32_t>& list : positions) bytes += list.capacity() * sizeof(std::uint32_t);
+        return bytes;
+    }
+};
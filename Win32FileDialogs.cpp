@@ -48,4 +48,9 @@ std::string SaveFileDialog(const char* filter)
 bool fileExists(const std::string& filename) {
     std::ifstream file(filename);
     return file.is_open();
+}
+
+bool AskYesNo(const char* title, const std::string& message)
+{
+    return MessageBoxA(NULL, message.c_str(), title, MB_YESNO | MB_ICONQUESTION) == IDYES;
 }
\ No newline at end of file
@@ -4,4 +4,6 @@
 
 std::string OpenFileDialog(const char* filter);
 std::string SaveFileDialog(const char* filter);
-bool fileExists(const std::string& filename);
\ No newline at end of file
+bool fileExists(const std::string& filename);
+// Yes/No message box, true for yes
+bool AskYesNo(const char* title, const std::string& message);
\ No newline at end of file